@@ -0,0 +1,80 @@
+//------------------------------------------------------------------------------
+// main.cc
+// (C) 2015-2018 Individual contributors, see AUTHORS file
+//------------------------------------------------------------------------------
+#include "config.h"
+#include "loader.h"
+#include "bounds.h"
+#include "swrast.h"
+#include "swshaders.h"
+#include "swimage.h"
+#include "color.h"
+
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <algorithm>
+
+/*
+ * Renders a mesh with the software rasterizer, without opening a window or creating a GL context,
+ * and writes the color and depth buffers to "<output>_color.<format>" and "<output>_depth.<format>" (PGM for PPM output).
+ * The mesh is scaled to fit the view, so any mesh can be rendered without tuning the camera.
+ *
+ * Usage: HeadlessRender [mesh] [texture] [output] [format = png|ppm] [frames] [size]
+ */
+int
+main(int argc, const char** argv)
+{
+	using namespace efiilj;
+
+	const std::string mesh_path = argc > 1 ? argv[1] : "./res/meshes/cat.obj";
+	const std::string texture_path = argc > 2 ? argv[2] : "./res/textures/fox_base.png";
+	const std::string output = argc > 3 ? argv[3] : "./headless";
+	const std::string format = argc > 4 ? argv[4] : "png";
+	const int frames = argc > 5 ? std::max(std::atoi(argv[5]), 1) : 1;
+	const int size = argc > 6 ? std::max(std::atoi(argv[6]), 1) : 1024;
+
+	object_loader loader(mesh_path.c_str());
+
+	if (!loader.is_valid())
+	{
+		std::cout << "Failed to load OBJ file " << mesh_path << "\n";
+		return 1;
+	}
+
+	std::cout << "Loaded " << loader.vertex_count() << " vertices, " << loader.index_count() << " indices\n";
+
+	// Fit the mesh into a unit sphere at the origin, in front of the camera
+	std::vector<vertex> vertices = loader.get_vertices();
+	const bounding_box& bounds = loader.bounds();
+	const vector4 center = (bounds.lower + bounds.upper) * 0.5f;
+	const float radius = std::max(vector4::dist(bounds.lower, bounds.upper) * 0.5f, 0.0001f);
+
+	auto node_trans_ptr = std::make_shared<transform_model>(vector3(-center.x() / radius, -center.y() / radius, -center.z() / radius), vector3(0), vector3(1 / radius, 1 / radius, 1 / radius));
+	auto camera_trans_ptr = std::make_shared<transform_model>(vector3(0, 0, 2.5f), vector3(0, -1.5707963f, 0), vector3(1, 1, 1));
+	auto camera_ptr = std::make_shared<camera_model>(1.3f, 1.0f, 0.1f, 100.0f, camera_trans_ptr, vector3(0, 1, 0));
+
+	auto rasterizer_ptr = std::make_shared<rasterizer>(size, size, camera_ptr, color(3, 0, 3, 127));
+	auto node_ptr = make_pipeline_node(std::move(vertices), loader.get_indices(), node_trans_ptr, phong_vertex_shader(), phong_fragment_shader());
+
+	auto tex_ptr = std::make_shared<texture_data>(texture_path.c_str());
+	node_ptr->texture(tex_ptr);
+
+	rasterizer_ptr->add_node(node_ptr);
+
+	for (int i = 0; i < frames; i++)
+		rasterizer_ptr->render();
+
+	const std::string color_path = output + "_color." + format;
+	const std::string depth_path = output + "_depth." + (format == "ppm" ? "pgm" : format);
+
+	if (!image_writer::write_color(color_path, rasterizer_ptr->get_frame_buffer(), size, size) ||
+		!image_writer::write_depth(depth_path, rasterizer_ptr->get_depth_buffer(), size, size))
+	{
+		std::cout << "Failed to write images to " << output << "\n";
+		return 1;
+	}
+
+	std::cout << "Wrote " << color_path << " and " << depth_path << "\n";
+	return 0;
+}
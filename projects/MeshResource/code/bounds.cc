@@ -0,0 +1,69 @@
+#include "bounds.h"
+
+#include <limits>
+#include <algorithm>
+
+namespace efiilj
+{
+	bounding_box::bounding_box()
+	{
+		const float inf = std::numeric_limits<float>::infinity();
+		lower = vector4(inf, inf, inf, 1);
+		upper = vector4(-inf, -inf, -inf, 1);
+	}
+
+	bounding_box::bounding_box(const vertex* vertices, const unsigned count)
+		: bounding_box()
+	{
+		for (unsigned i = 0; i < count; i++)
+			add(vertices[i].xyzw);
+	}
+
+	void bounding_box::add(const vector4& point)
+	{
+		lower = vector4(std::min(lower.x(), point.x()), std::min(lower.y(), point.y()), std::min(lower.z(), point.z()), 1);
+		upper = vector4(std::max(upper.x(), point.x()), std::max(upper.y(), point.y()), std::max(upper.z(), point.z()), 1);
+	}
+
+	view_frustum::view_frustum(const matrix4& clip)
+	{
+		const vector4 x = clip.row(0);
+		const vector4 y = clip.row(1);
+		const vector4 z = clip.row(2);
+		const vector4 w = clip.row(3);
+
+		// Each plane (a, b, c, d) contains the points where ax + by + cz + d >= 0
+		const auto plane = [](const vector4& a, const vector4& b, const float sign)
+		{
+			return vector4(a.x() + b.x() * sign, a.y() + b.y() * sign, a.z() + b.z() * sign, a.w() + b.w() * sign);
+		};
+
+		planes_[0] = plane(w, x, 1);	// Left
+		planes_[1] = plane(w, x, -1);	// Right
+		planes_[2] = plane(w, y, 1);	// Bottom
+		planes_[3] = plane(w, y, -1);	// Top
+		planes_[4] = z;					// Near
+		planes_[5] = plane(w, z, -1);	// Far
+	}
+
+	bool view_frustum::intersects(const bounding_box& box) const
+	{
+		if (box.is_empty())
+			return false;
+
+		for (const auto& plane : planes_)
+		{
+			// Test the corner of the box furthest along the plane normal
+			const float distance =
+				plane.x() * (plane.x() >= 0 ? box.upper.x() : box.lower.x()) +
+				plane.y() * (plane.y() >= 0 ? box.upper.y() : box.lower.y()) +
+				plane.z() * (plane.z() >= 0 ? box.upper.z() : box.lower.z()) +
+				plane.w();
+
+			if (distance < 0)
+				return false;
+		}
+
+		return true;
+	}
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "vertex.h"
+
+namespace efiilj
+{
+	/**
+	 * \brief An axis-aligned bounding box in object-space.
+	 */
+	struct bounding_box
+	{
+		/**
+		 * \brief Creates an empty bounding box, which contains no points.
+		 */
+		bounding_box();
+
+		/**
+		 * \brief Creates a bounding box enclosing the positions of a list of vertices.
+		 * \param vertices List of vertices to enclose
+		 * \param count Size of the vertex list
+		 */
+		bounding_box(const vertex* vertices, unsigned count);
+
+		vector4 lower;
+		vector4 upper;
+
+		/**
+		 * \brief Grows the bounding box to enclose a point.
+		 * \param point The point which should be enclosed
+		 */
+		void add(const vector4& point);
+
+		/**
+		 * \brief Checks whether the bounding box contains no points.
+		 * \return True if no point has been added, false otherwise
+		 */
+		bool is_empty() const { return lower.x() > upper.x(); }
+	};
+
+	/**
+	 * \brief The six planes of a view frustum, used to cull bounding volumes before drawing.
+	 */
+	class view_frustum
+	{
+	private:
+
+		vector4 planes_[6];
+
+	public:
+
+		/**
+		 * \brief Extracts the frustum planes from a clip matrix.
+		 * The planes are expressed in the space the matrix transforms from, so passing view/perspective * model
+		 * allows bounding boxes to be tested in object-space.
+		 * \param clip Matrix transforming into clip-space, where the near plane is z = 0 and the far plane z = w
+		 */
+		explicit view_frustum(const matrix4& clip);
+
+		/**
+		 * \brief Tests a bounding box against the frustum.
+		 * \param box The bounding box to test, in the space of the clip matrix
+		 * \return False if the box lies entirely outside one of the planes, true otherwise (including when it may be visible)
+		 */
+		bool intersects(const bounding_box& box) const;
+	};
+}
@@ -11,7 +11,7 @@ namespace efiilj
 
 	matrix4 camera_model::view_perspective() const
 	{
-		const vector4 camera_pos = transform_->position;
+		const vector4 camera_pos = transform_->position();
 		const vector4 camera_direction = transform_->backward();
 		const vector4 camera_right = transform_->right();
 		const vector4 camera_up = transform_->up();
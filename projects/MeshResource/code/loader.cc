@@ -4,195 +4,870 @@
 #include <fstream>
 #include <iostream>
 #include <vector>
-#include <map>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <cstdint>
+#include <algorithm>
+#include <cmath>
+#include <thread>
 
 namespace efiilj
 {
-	bool object_loader::load_from_file(const char* path)
+	bool object_loader::read_file(const char* path, std::vector<char>& buffer)
 	{
-		std::string s;
-		std::ifstream file(path);
+		std::ifstream file(path, std::ios::binary | std::ios::ate);
 
-		std::vector<unsigned int> vertex_indices, uv_indices, normal_indices;
-		std::vector<vector3> vertices;
-		std::vector<vector3> normals;
-		std::vector<vector2> uvs;
+		if (!file.is_open())
+			return false;
+
+		const std::streamoff size = file.tellg();
+		if (size < 0)
+			return false;
+
+		buffer.resize(static_cast<size_t>(size) + 1);
+		file.seekg(0);
+
+		if (!file.read(buffer.data(), size))
+			return false;
 
-		std::vector<vertex> packed_vertices;
+		buffer[static_cast<size_t>(size)] = '\0';
+		return true;
+	}
+
+	bool object_loader::parse_float(const char*& cursor, float& value)
+	{
+		// Powers of ten which are exactly representable as doubles
+		static const double powers[] =
+		{
+			1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+			1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+		};
+
+		const char* c = cursor;
+		while (*c == ' ' || *c == '\t')
+			c++;
 
-		if (file.is_open())
+		const char* start = c;
+		const bool negative = *c == '-';
+		if (*c == '-' || *c == '+')
+			c++;
+
+		// Accumulate up to 15 significant digits, which converts to a double without rounding
+		uint64_t mantissa = 0;
+		int digits = 0, exponent = 0;
+		bool any = false, exact = true;
+
+		for (; *c >= '0' && *c <= '9'; c++, any = true)
 		{
-			while (std::getline(file, s))
+			if (digits < 15)
+			{
+				mantissa = mantissa * 10 + (*c - '0');
+				digits += mantissa != 0;
+			}
+			else
 			{
-				const char* cs = s.c_str();
+				exact = false;
+			}
+		}
 
-				// Vertex normals
-				if (_strnicmp(cs, "vn", 2) == 0)
+		if (*c == '.')
+		{
+			for (c++; *c >= '0' && *c <= '9'; c++, any = true)
+			{
+				if (digits < 15)
 				{
-					vector3 norm;
-
-					// Get three floats and add to normals vector
-					if (sscanf_s(&cs[2], "%f %f %f", &norm[0], &norm[1], &norm[2]) == 3)
-						normals.push_back(norm);
-					else
-					{
-						std::cout << "\nError when loading OBJ file - failed to parse normal data (" << cs << ")" << std::endl;
-						return false;
-					}
+					mantissa = mantissa * 10 + (*c - '0');
+					digits += mantissa != 0;
+					exponent--;
 				}
-				// Texture coordinates
-				else if (_strnicmp(cs, "vt", 2) == 0)
+				else
 				{
-					vector2 uv;
-
-					// Get two values and add to uvs vector
-					if (sscanf_s(&cs[2], "%f %f", &uv[0], &uv[1]) == 2)
-						uvs.push_back(uv);
-					else
-					{
-						std::cout << "\nError when loading OBJ file - failed to parse uv data (" << cs << ")" << std::endl;
-						return false;
-					}
+					exact = false;
 				}
-				// Vertices
-				else if (_strnicmp(cs, "v", 1) == 0)
+			}
+		}
+
+		if (any && (*c == 'e' || *c == 'E'))
+		{
+			const char* e = c + 1;
+			const bool negative_exponent = *e == '-';
+			if (*e == '-' || *e == '+')
+				e++;
+
+			if (*e >= '0' && *e <= '9')
+			{
+				int power = 0;
+				for (; *e >= '0' && *e <= '9'; e++)
+					power = std::min(power * 10 + (*e - '0'), 1000);
+
+				exponent += negative_exponent ? -power : power;
+				c = e;
+			}
+		}
+
+		if (!any || !exact || exponent < -22 || exponent > 22)
+		{
+			// Leave anything the fast path cannot convert exactly (including inf and nan) to the C library
+			if (*start == '\0' || *start == '\r' || *start == '\n')
+				return false;
+
+			char* end;
+			value = std::strtof(start, &end);
+
+			if (end == start)
+				return false;
+
+			cursor = end;
+			return true;
+		}
+
+		const double magnitude = exponent < 0
+			? static_cast<double>(mantissa) / powers[-exponent]
+			: static_cast<double>(mantissa) * powers[exponent];
+
+		value = static_cast<float>(negative ? -magnitude : magnitude);
+		cursor = c;
+		return true;
+	}
+
+	bool object_loader::parse_index(const char*& cursor, const size_t count, int& index, bool& relative)
+	{
+		const char* c = cursor;
+		const bool negative = *c == '-';
+		if (negative)
+			c++;
+
+		if (*c < '0' || *c > '9')
+			return false;
+
+		int64_t value = 0;
+		for (; *c >= '0' && *c <= '9'; c++)
+			value = std::min<int64_t>(value * 10 + (*c - '0'), INT32_MAX);
+
+		if (value == 0)
+			return false;
+
+		// Relative indices count backwards from the last element defined so far, which may lie in an earlier chunk
+		relative = negative;
+		index = negative
+			? static_cast<int>(std::max<int64_t>(static_cast<int64_t>(count) - value, INT32_MIN))
+			: static_cast<int>(value);
+
+		cursor = c;
+		return true;
+	}
+
+	bool object_loader::parse_corner(const char*& cursor, const size_t* counts, face_corner& corner)
+	{
+		const char* c = cursor;
+		while (*c == ' ' || *c == '\t')
+			c++;
+
+		corner.uv = 0;
+		corner.normal = 0;
+		corner.relative = 0;
+
+		bool relative;
+
+		if (!parse_index(c, counts[0], corner.vertex, relative))
+			return false;
+
+		corner.relative |= relative ? 1 : 0;
+
+		if (*c == '/')
+		{
+			c++;
+
+			if (*c != '/')
+			{
+				if (!parse_index(c, counts[1], corner.uv, relative))
+					return false;
+
+				corner.relative |= relative ? 2 : 0;
+			}
+
+			if (*c == '/')
+			{
+				c++;
+
+				if (!parse_index(c, counts[2], corner.normal, relative))
+					return false;
+
+				corner.relative |= relative ? 4 : 0;
+			}
+		}
+
+		cursor = c;
+		return true;
+	}
+
+	void object_loader::parse_chunk(obj_chunk& chunk)
+	{
+		const char* const begin = chunk.begin;
+		const char* const end = chunk.end;
+
+		// Count the elements of each kind first, so that no vector has to grow while parsing
+		size_t vertex_count = 0, uv_count = 0, normal_count = 0, corner_count = 0;
+
+		for (const char* line = begin; line < end; )
+		{
+			const char* eol = static_cast<const char*>(std::memchr(line, '\n', end - line));
+			if (eol == nullptr)
+				eol = end;
+
+			if (line[0] == 'v')
+			{
+				vertex_count += line[1] == ' ' || line[1] == '\t';
+				uv_count += line[1] == 't';
+				normal_count += line[1] == 'n';
+			}
+			else if (line[0] == 'f')
+			{
+				// Every corner past the second adds a triangle to the fan
+				unsigned corners = 0;
+				for (const char* c = line + 1; c < eol; c++)
+					corners += (c[-1] == ' ' || c[-1] == '\t') && c[0] != ' ' && c[0] != '\t' && c[0] != '\r';
+
+				corner_count += corners > 2 ? (corners - 2) * 3 : 0;
+			}
+
+			line = eol + 1;
+		}
+
+		std::vector<vector3>& vertices = chunk.vertices;
+		std::vector<vector3>& normals = chunk.normals;
+		std::vector<vector2>& uvs = chunk.uvs;
+		std::vector<face_corner>& corners = chunk.corners;
+		std::vector<face_corner> polygon;
+
+		vertices.reserve(vertex_count);
+		uvs.reserve(uv_count);
+		normals.reserve(normal_count);
+		corners.reserve(corner_count);
+
+		for (const char* line = begin; line < end; )
+		{
+			const char* eol = static_cast<const char*>(std::memchr(line, '\n', end - line));
+			if (eol == nullptr)
+				eol = end;
+
+			const char* c = line;
+
+			// Vertex normals
+			if (c[0] == 'v' && c[1] == 'n')
+			{
+				vector3 norm;
+				c += 2;
+
+				// Get three floats and add to normals vector
+				if (parse_float(c, norm[0]) && parse_float(c, norm[1]) && parse_float(c, norm[2]))
+					normals.push_back(norm);
+				else
 				{
-					vector3 vert;
+					chunk.error = "failed to parse normal data (" + std::string(line, eol) + ")";
+					return;
+				}
+			}
+			// Texture coordinates
+			else if (c[0] == 'v' && c[1] == 't')
+			{
+				vector2 uv;
+				c += 2;
 
-					// Get three floats and add to vertices vector
-					if (sscanf_s(&cs[1], "%f %f %f", &vert[0], &vert[1], &vert[2]) == 3)
-						vertices.push_back(vert);
-					else
-					{
-						std::cout << "\nError when loading OBJ file - failed to parse vertex data (" << cs << ")" << std
-							::endl;
-						return false;
-					}
+				// Get two values and add to uvs vector
+				if (parse_float(c, uv[0]) && parse_float(c, uv[1]))
+					uvs.push_back(uv);
+				else
+				{
+					chunk.error = "failed to parse uv data (" + std::string(line, eol) + ")";
+					return;
 				}
-				// Faces
-				else if (_strnicmp(cs, "f", 1) == 0)
+			}
+			// Vertices
+			else if (c[0] == 'v' && (c[1] == ' ' || c[1] == '\t'))
+			{
+				vector3 vert;
+				c += 1;
+
+				// Get three floats and add to vertices vector
+				if (parse_float(c, vert[0]) && parse_float(c, vert[1]) && parse_float(c, vert[2]))
+					vertices.push_back(vert);
+				else
 				{
-					unsigned int vertex_index[4], uv_index[4], normal_index[4];
+					chunk.error = "failed to parse vertex data (" + std::string(line, eol) + ")";
+					return;
+				}
+			}
+			// Faces
+			else if (c[0] == 'f' && (c[1] == ' ' || c[1] == '\t'))
+			{
+				const size_t counts[] = { vertices.size(), uvs.size(), normals.size() };
+				face_corner corner;
 
-					// Get 12 (quad) or 9 (tri) floats and add to index vectors
-					int matches = sscanf_s(&cs[1], "%d/%d/%d %d/%d/%d %d/%d/%d %d/%d/%d", 
-					                     &vertex_index[0], &uv_index[0], &normal_index[0],
-					                     &vertex_index[1], &uv_index[1], &normal_index[1],
-					                     &vertex_index[2], &uv_index[2], &normal_index[2],
-					                     &vertex_index[3], &uv_index[3], &normal_index[3]);
+				c += 1;
+				polygon.clear();
 
-					if (matches >= 9) // Face is valid
-					{
-						// Add indices to index arrays (vertex, uv, normals)
-						
-						vertex_indices.push_back(vertex_index[0]);
-						vertex_indices.push_back(vertex_index[1]);
-						vertex_indices.push_back(vertex_index[2]);
-
-						uv_indices.push_back(uv_index[0]);
-						uv_indices.push_back(uv_index[1]);
-						uv_indices.push_back(uv_index[2]);
-
-						normal_indices.push_back(normal_index[0]);
-						normal_indices.push_back(normal_index[1]);
-						normal_indices.push_back(normal_index[2]);
-
-						if (matches == 12)
-						{
-							// Face is quad - add another tri
-							
-							vertex_indices.push_back(vertex_index[2]);
-							vertex_indices.push_back(vertex_index[3]);
-							vertex_indices.push_back(vertex_index[0]);
-
-							uv_indices.push_back(uv_index[3]);
-							uv_indices.push_back(uv_index[2]);
-							uv_indices.push_back(uv_index[0]);
-
-							normal_indices.push_back(normal_index[2]);
-							normal_indices.push_back(normal_index[3]);
-							normal_indices.push_back(normal_index[0]);
-						}
-					}
-					else
+				while (parse_corner(c, counts, corner))
+					polygon.push_back(corner);
+
+				while (*c == ' ' || *c == '\t' || *c == '\r')
+					c++;
+
+				if (polygon.size() >= 3 && c >= eol)
+				{
+					// Triangulate the polygon as a fan, in the same order as quads have always been split
+					corners.push_back(polygon[0]);
+					corners.push_back(polygon[1]);
+					corners.push_back(polygon[2]);
+
+					for (size_t i = 2; i + 1 < polygon.size(); i++)
 					{
-						std::cout << "\nError when loading OBJ file - failed to parse face data (" << cs << ")" << std::endl;
-						return false;
+						corners.push_back(polygon[i]);
+						corners.push_back(polygon[i + 1]);
+						corners.push_back(polygon[0]);
 					}
 				}
+				else
+				{
+					chunk.error = "failed to parse face data (" + std::string(line, eol) + ")";
+					return;
+				}
 			}
 
-			for (unsigned int i = 0; i < vertex_indices.size(); i++)
-			{
-				// Convert loose vertices/indices to Vertex objects
-				
-				unsigned int vertex_index = vertex_indices[i];
-				unsigned int uv_index = uv_indices[i];
-				unsigned int normal_index = normal_indices[i];
+			line = eol + 1;
+		}
+	}
+
+	void object_loader::run_parallel(const size_t count, const std::function<void(size_t)>& job)
+	{
+		std::vector<std::thread> threads;
+
+		// The calling thread takes the first job
+		for (size_t i = 1; i < count; i++)
+			threads.emplace_back(job, i);
 
-				vector3 xyzw = vertices[vertex_index - 1];
-				vector3 norm = normals[normal_index - 1];
-				vector2 uv = uvs[uv_index - 1];
+		if (count > 0)
+			job(0);
+
+		for (auto& thread : threads)
+			thread.join();
+	}
+
+	bool object_loader::pack_chunk(const obj_chunk& chunk, const size_t* offsets, const std::vector<vector3>& vertices,
+	                               const std::vector<vector2>& uvs, const std::vector<vector3>& normals, vertex* out)
+	{
+		const size_t totals[] = { vertices.size(), uvs.size(), normals.size() };
+
+		for (const auto& corner : chunk.corners)
+		{
+			// Convert loose vertices/indices to Vertex objects
+
+			const int indices[] = { corner.vertex, corner.uv, corner.normal };
+			int64_t resolved[3];
+
+			for (int i = 0; i < 3; i++)
+			{
+				const bool relative = (corner.relative & (1 << i)) != 0;
+				resolved[i] = relative ? static_cast<int64_t>(offsets[i]) + indices[i] + 1 : indices[i];
 
-				packed_vertices.emplace_back(xyzw, norm, vector4(1, 1, 1, 1), uv);
+				// Only texture coordinates and normals may be omitted
+				if (resolved[i] < (i == 0 || relative ? 1 : 0) || resolved[i] > static_cast<int64_t>(totals[i]))
+					return false;
 			}
+
+			const vector3& xyzw = vertices[static_cast<size_t>(resolved[0] - 1)];
+			const vector2 uv = resolved[1] != 0 ? uvs[static_cast<size_t>(resolved[1] - 1)] : vector2(0, 0);
+			const vector3 norm = resolved[2] != 0 ? normals[static_cast<size_t>(resolved[2] - 1)] : vector3(0, 0, 0);
+
+			*out++ = vertex(xyzw, norm, vector4(1, 1, 1, 1), uv);
 		}
-		else
+
+		return true;
+	}
+
+	bool object_loader::load_from_file(const char* path)
+	{
+		std::vector<char> buffer;
+
+		if (!read_file(path, buffer))
 		{
 			std::cout << "\nError when loading OBJ file - could not open file (" << path << ")" << std::endl;
 			return false;
 		}
 
-		file.close();
+		const char* const begin = buffer.data();
+		const char* const end = begin + buffer.size() - 1;
+		const size_t size = buffer.size() - 1;
+
+		// Split large files into chunks which end at line breaks, and parse each chunk on its own thread
+		const unsigned threads = threads_ != 0 ? threads_ : std::max(std::thread::hardware_concurrency(), 1u);
+		const size_t chunk_count = std::max<size_t>(std::min<size_t>(size / min_chunk_size_, threads), 1);
+
+		std::vector<obj_chunk> chunks(chunk_count);
+		const char* chunk_begin = begin;
+
+		for (size_t i = 0; i < chunk_count; i++)
+		{
+			const char* chunk_end = i + 1 < chunk_count ? std::max(begin + size * (i + 1) / chunk_count, chunk_begin) : end;
+			const char* eol = static_cast<const char*>(std::memchr(chunk_end, '\n', end - chunk_end));
+			chunk_end = eol != nullptr ? eol + 1 : end;
+
+			chunks[i].begin = chunk_begin;
+			chunks[i].end = chunk_end;
+			chunk_begin = chunk_end;
+		}
+
+		run_parallel(chunk_count, [&chunks](const size_t i) { parse_chunk(chunks[i]); });
+
+		for (const auto& chunk : chunks)
+		{
+			if (!chunk.error.empty())
+			{
+				std::cout << "\nError when loading OBJ file - " << chunk.error << std::endl;
+				return false;
+			}
+		}
+
+		// Each chunk refers to elements by global index, except for relative indices which need the offset of the chunk
+		std::vector<vector3> vertices;
+		std::vector<vector3> normals;
+		std::vector<vector2> uvs;
+		std::vector<size_t> offsets(chunk_count * 3);
+		std::vector<size_t> bases(chunk_count);
+		size_t corner_count = 0;
+
+		for (size_t i = 0; i < chunk_count; i++)
+		{
+			offsets[i * 3 + 0] = vertices.size();
+			offsets[i * 3 + 1] = uvs.size();
+			offsets[i * 3 + 2] = normals.size();
+			bases[i] = corner_count;
+
+			corner_count += chunks[i].corners.size();
+
+			// A file parsed as a single chunk hands over its elements without copying them
+			if (chunk_count == 1)
+			{
+				vertices.swap(chunks[i].vertices);
+				uvs.swap(chunks[i].uvs);
+				normals.swap(chunks[i].normals);
+				continue;
+			}
+
+			vertices.insert(vertices.end(), chunks[i].vertices.begin(), chunks[i].vertices.end());
+			uvs.insert(uvs.end(), chunks[i].uvs.begin(), chunks[i].uvs.end());
+			normals.insert(normals.end(), chunks[i].normals.begin(), chunks[i].normals.end());
+		}
+
+		std::vector<vertex> packed_vertices(corner_count);
+		std::vector<char> valid(chunk_count, 0);
+
+		run_parallel(chunk_count, [&](const size_t i)
+		{
+			valid[i] = pack_chunk(chunks[i], &offsets[i * 3], vertices, uvs, normals, packed_vertices.data() + bases[i]);
+		});
+
+		if (std::find(valid.begin(), valid.end(), 0) != valid.end())
+		{
+			std::cout << "\nError when loading OBJ file - face index out of range (" << path << ")" << std::endl;
+			return false;
+		}
 
 		// Optimize vertex buffers and return whether successful
 		return find_indices(packed_vertices);
 	}
 
+	uint32_t object_loader::hash_words(const void* data, const size_t size)
+	{
+		const auto* bytes = static_cast<const unsigned char*>(data);
+		uint32_t hash = 0x811c9dc5;
+
+		for (size_t i = 0; i + 4 <= size; i += 4)
+		{
+			uint32_t word;
+			std::memcpy(&word, bytes + i, 4);
+
+			word *= 0xcc9e2d51;
+			word = (word << 15) | (word >> 17);
+			hash ^= word * 0x1b873593;
+			hash = ((hash << 13) | (hash >> 19)) * 5 + 0xe6546b64;
+		}
+
+		// Mix the final hash so that the low bits used for the table slot depend on every word
+		hash ^= hash >> 16;
+		hash *= 0x85ebca6b;
+		hash ^= hash >> 13;
+		hash *= 0xc2b2ae35;
+		hash ^= hash >> 16;
+
+		return hash;
+	}
+
+	object_loader::vertex_key object_loader::quantize(const vertex& v, const float tolerance)
+	{
+		const float components[] =
+		{
+			v.xyzw.x(), v.xyzw.y(), v.xyzw.z(), v.xyzw.w(),
+			v.normal.x(), v.normal.y(), v.normal.z(), v.normal.w(),
+			v.rgba.x(), v.rgba.y(), v.rgba.z(), v.rgba.w(),
+			v.uv.x(), v.uv.y()
+		};
+
+		vertex_key key;
+		for (int i = 0; i < 14; i++)
+			key.components[i] = std::llround(components[i] / tolerance);
+
+		return key;
+	}
+
 	bool object_loader::find_indices(std::vector<vertex>& in_vertices)
 	{
-		const int count = in_vertices.size();
+		const size_t count = in_vertices.size();
 
 		if (count < 3)
 			return false;
 
 		index_list_.clear();
 		vertex_list_.clear();
+		index_list_.reserve(count);
 
-		// Map holds vertices and their corresponding indices
-		std::map<vertex, unsigned int> vertices;
+		// Open addressing table of indices into the vertex list, kept at most half full so that probe sequences stay short
+		const unsigned empty = UINT32_MAX;
+		size_t capacity = 16;
+		while (capacity < count * 2)
+			capacity <<= 1;
 
-		for (int i = 0; i < count; i++)
+		std::vector<unsigned> table(capacity, empty);
+		const size_t mask = capacity - 1;
+
+		const bool weld = weld_tolerance_ > 0;
+		std::vector<vertex_key> keys;
+
+		for (size_t i = 0; i < count; i++)
 		{
-			vertex test = in_vertices[i];
+			const vertex& test = in_vertices[i];
+			vertex_key key;
+
+			if (weld)
+				key = quantize(test, weld_tolerance_);
+
+			size_t slot = (weld ? hash_words(&key, sizeof(vertex_key)) : hash_words(&test, sizeof(vertex))) & mask;
 
-			// Try to find vertices identical to this one in map
-			auto it = vertices.find(test);
-			if (it != vertices.end())
+			// Probe linearly until an identical vertex or an empty slot is found
+			while (true)
 			{
-				// Add vertex index if an identical vertex exists
-				index_list_.push_back(it->second);
+				const unsigned index = table[slot];
+
+				if (index == empty)
+				{
+					// Add vertex and index if no similar vertex is found
+					table[slot] = static_cast<unsigned>(vertex_list_.size());
+					index_list_.push_back(table[slot]);
+					vertex_list_.push_back(test);
+
+					if (weld)
+						keys.push_back(key);
+
+					break;
+				}
+
+				const bool identical = weld
+					? std::memcmp(&keys[index], &key, sizeof(vertex_key)) == 0
+					: std::memcmp(&vertex_list_[index], &test, sizeof(vertex)) == 0;
+
+				if (identical)
+				{
+					// Add vertex index if an identical vertex exists
+					index_list_.push_back(index);
+					break;
+				}
+
+				slot = (slot + 1) & mask;
 			}
-			else
+		}
+
+		return !index_list_.empty();
+	}
+
+	float object_loader::get_acmr(const unsigned* indices, const size_t index_count, const unsigned vertex_count, const unsigned cache_size)
+	{
+		if (index_count < 3)
+			return 0;
+
+		// A vertex is in the FIFO if fewer than cache_size misses have happened since it was inserted
+		std::vector<size_t> inserted(vertex_count, 0);
+		size_t misses = 0;
+
+		for (size_t i = 0; i < index_count; i++)
+		{
+			const unsigned index = indices[i];
+
+			if (inserted[index] == 0 || misses - inserted[index] + 1 > cache_size)
 			{
-				// Add vertex and index if no similar vertex is found
-				vertex_list_.push_back(test);
-				unsigned int index = static_cast<unsigned int>(vertex_list_.size()) - 1;
-				index_list_.push_back(index);
-				vertices[test] = index;
+				misses++;
+				inserted[index] = misses;
 			}
 		}
 
-		return !index_list_.empty();
+		return static_cast<float>(misses) / static_cast<float>(index_count / 3);
 	}
 
-	object_loader::object_loader(const char* path)
+	std::vector<unsigned> object_loader::tipsify(const std::vector<unsigned>& indices, const unsigned vertex_count, const unsigned cache_size)
 	{
+		const size_t face_count = indices.size() / 3;
+
+		// Build vertex to face adjacency in compressed rows
+		std::vector<unsigned> live(vertex_count, 0);
+		for (const unsigned index : indices)
+			live[index]++;
+
+		std::vector<size_t> offsets(vertex_count + 1, 0);
+		for (unsigned v = 0; v < vertex_count; v++)
+			offsets[v + 1] = offsets[v] + live[v];
+
+		std::vector<unsigned> adjacency(indices.size());
+		std::vector<size_t> fill(offsets.begin(), offsets.end() - 1);
+		for (size_t i = 0; i < indices.size(); i++)
+			adjacency[fill[indices[i]]++] = static_cast<unsigned>(i / 3);
+
+		std::vector<unsigned> result;
+		result.reserve(indices.size());
+
+		std::vector<size_t> cache_time(vertex_count, 0);
+		std::vector<char> emitted(face_count, 0);
+		std::vector<unsigned> dead_ends;
+		std::vector<unsigned> candidates;
+
+		size_t time = cache_size + 1;
+		unsigned cursor = 0;
+		int fan = vertex_count > 0 ? 0 : -1;
+
+		while (fan >= 0)
+		{
+			candidates.clear();
+
+			// Emit every remaining face around the fanning vertex
+			for (size_t a = offsets[fan]; a < offsets[fan + 1]; a++)
+			{
+				const unsigned face = adjacency[a];
+				if (emitted[face])
+					continue;
+
+				for (int k = 0; k < 3; k++)
+				{
+					const unsigned v = indices[face * 3 + k];
+					result.push_back(v);
+					dead_ends.push_back(v);
+					candidates.push_back(v);
+					live[v]--;
+
+					if (time - cache_time[v] > cache_size)
+						cache_time[v] = time++;
+				}
+
+				emitted[face] = 1;
+			}
+
+			// Continue from the candidate which will stay in the cache longest while its remaining faces are emitted
+			fan = -1;
+			size_t best = 0;
+
+			for (const unsigned v : candidates)
+			{
+				if (live[v] == 0)
+					continue;
+
+				size_t priority = 0;
+				if (time - cache_time[v] + 2 * live[v] <= cache_size)
+					priority = time - cache_time[v];
+
+				if (fan < 0 || priority > best)
+				{
+					best = priority;
+					fan = static_cast<int>(v);
+				}
+			}
+
+			if (fan >= 0)
+				continue;
+
+			// Otherwise back up to a recently used vertex with faces left, or the next such vertex in input order
+			while (!dead_ends.empty() && fan < 0)
+			{
+				const unsigned v = dead_ends.back();
+				dead_ends.pop_back();
+
+				if (live[v] > 0)
+					fan = static_cast<int>(v);
+			}
+
+			while (fan < 0 && cursor < vertex_count)
+			{
+				if (live[cursor] > 0)
+					fan = static_cast<int>(cursor);
+
+				cursor++;
+			}
+		}
+
+		return result;
+	}
+
+	void object_loader::optimize_vertex_cache()
+	{
+		const auto vertex_count = static_cast<unsigned>(vertex_list_.size());
+		std::vector<unsigned> indices = tipsify(index_list_, vertex_count, acmr_cache_size_);
+
+		// Renumber vertices in the order they are first used, so that fetching them walks memory forwards
+		const unsigned unused = UINT32_MAX;
+		std::vector<unsigned> remap(vertex_count, unused);
+		std::vector<vertex> vertices;
+		vertices.reserve(vertex_count);
+
+		for (unsigned& index : indices)
+		{
+			if (remap[index] == unused)
+			{
+				remap[index] = static_cast<unsigned>(vertices.size());
+				vertices.push_back(vertex_list_[index]);
+			}
+
+			index = remap[index];
+		}
+
+		vertex_list_.swap(vertices);
+		index_list_.swap(indices);
+	}
+
+	bool object_loader::load_from_cache(const char* path)
+	{
+		uint64_t source_size;
+		int64_t source_mtime;
+
+		if (!file_mapping::get_stamp(path, source_size, source_mtime))
+			return false;
+
+		std::unique_ptr<file_mapping> cache(new file_mapping(cache_path(path).c_str()));
+
+		if (!cache->is_valid() || cache->size() < sizeof(cache_header))
+			return false;
+
+		cache_header header;
+		std::memcpy(&header, cache->data(), sizeof(cache_header));
+
+		// Rebuild caches of other versions of the file, or written with another vertex layout, weld tolerance or ordering
+		if (std::memcmp(header.magic, "OBJC", 4) != 0 || header.version != cache_version_ || header.vertex_size != sizeof(vertex)
+			|| header.weld_tolerance != weld_tolerance_ || header.optimized != (optimize_ ? 1u : 0u)
+			|| header.source_size != source_size || header.source_mtime != source_mtime)
+			return false;
+
+		if (header.index_count == 0 || cache->size() != sizeof(cache_header)
+			+ static_cast<size_t>(header.vertex_count) * sizeof(vertex) + static_cast<size_t>(header.index_count) * sizeof(unsigned))
+			return false;
+
+		vertex_data_ = reinterpret_cast<const vertex*>(cache->data() + sizeof(cache_header));
+		index_data_ = reinterpret_cast<const unsigned*>(vertex_data_ + header.vertex_count);
+		vertex_count_ = header.vertex_count;
+		index_count_ = header.index_count;
+		bounds_.lower = vector4(header.lower[0], header.lower[1], header.lower[2], header.lower[3]);
+		bounds_.upper = vector4(header.upper[0], header.upper[1], header.upper[2], header.upper[3]);
+		acmr_before_ = header.acmr_before;
+		acmr_after_ = header.acmr_after;
+
+		cache_ = std::move(cache);
+		return true;
+	}
+
+	bool object_loader::write_cache(const char* path) const
+	{
+		cache_header header = {};
+		std::memcpy(header.magic, "OBJC", 4);
+		header.version = cache_version_;
+		header.vertex_size = sizeof(vertex);
+		header.vertex_count = vertex_count_;
+		header.index_count = index_count_;
+		header.weld_tolerance = weld_tolerance_;
+		header.optimized = optimize_ ? 1 : 0;
+		header.acmr_before = acmr_before_;
+		header.acmr_after = acmr_after_;
+
+		if (!file_mapping::get_stamp(path, header.source_size, header.source_mtime))
+			return false;
+
+		const float lower[] = { bounds_.lower.x(), bounds_.lower.y(), bounds_.lower.z(), bounds_.lower.w() };
+		const float upper[] = { bounds_.upper.x(), bounds_.upper.y(), bounds_.upper.z(), bounds_.upper.w() };
+		std::memcpy(header.lower, lower, sizeof(lower));
+		std::memcpy(header.upper, upper, sizeof(upper));
+
+		// Write to a temporary file first, so that a cache is never seen half written
+		const std::string cache = cache_path(path);
+		const std::string temp = cache + ".tmp";
+
+		{
+			std::ofstream file(temp, std::ios::binary | std::ios::trunc);
+
+			if (!file.is_open())
+				return false;
+
+			file.write(reinterpret_cast<const char*>(&header), sizeof(cache_header));
+			file.write(reinterpret_cast<const char*>(vertex_data_), static_cast<std::streamsize>(vertex_count_ * sizeof(vertex)));
+			file.write(reinterpret_cast<const char*>(index_data_), static_cast<std::streamsize>(index_count_ * sizeof(unsigned)));
+
+			if (!file.good())
+			{
+				file.close();
+				std::remove(temp.c_str());
+				return false;
+			}
+		}
+
+		std::remove(cache.c_str());
+		return std::rename(temp.c_str(), cache.c_str()) == 0;
+	}
+
+	object_loader::object_loader(const char* path, const float weld_tolerance, const bool use_cache, const unsigned threads, const bool optimize)
+		: vertex_data_(nullptr), index_data_(nullptr), vertex_count_(0), index_count_(0), weld_tolerance_(weld_tolerance), threads_(threads),
+		  optimize_(optimize), acmr_before_(0), acmr_after_(0)
+	{
+		if (use_cache && load_from_cache(path))
+		{
+			is_valid_ = true;
+			return;
+		}
+
 		is_valid_ = load_from_file(path);
+
+		if (is_valid_)
+		{
+			const auto vertex_count = static_cast<unsigned>(vertex_list_.size());
+			acmr_before_ = get_acmr(index_list_.data(), index_list_.size(), vertex_count, acmr_cache_size_);
+
+			if (optimize_)
+				optimize_vertex_cache();
+
+			acmr_after_ = get_acmr(index_list_.data(), index_list_.size(), vertex_count, acmr_cache_size_);
+		}
+
+		vertex_data_ = vertex_list_.data();
+		index_data_ = index_list_.data();
+		vertex_count_ = static_cast<unsigned>(vertex_list_.size());
+		index_count_ = static_cast<unsigned>(index_list_.size());
+		bounds_ = bounding_box(vertex_data_, vertex_count_);
+
+		// A cache which cannot be written (such as in a read-only directory) only means parsing again next time
+		if (is_valid_ && use_cache)
+			write_cache(path);
 	}
 
-	mesh_resource object_loader::get_resource()
+	std::vector<packed_vertex> object_loader::get_packed_vertices() const
 	{
-		return mesh_resource(vertex_list_.data(), vertex_count(), index_list_.data(), index_count());
+		std::vector<packed_vertex> packed(vertex_count_);
+
+		for (unsigned i = 0; i < vertex_count_; i++)
+			packed[i] = packed_vertex::pack(vertex_data_[i], bounds_);
+
+		return packed;
 	}
 }
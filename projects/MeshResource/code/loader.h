@@ -2,8 +2,14 @@
 
 #include "vertex.h"
 #include "mesh_res.h"
+#include "bounds.h"
+#include "mapping.h"
 
 #include <vector>
+#include <memory>
+#include <string>
+#include <functional>
+#include <cstdint>
 
 namespace efiilj
 {
@@ -14,20 +20,216 @@ namespace efiilj
 	{
 	private:
 
+		/**
+		 * \brief The position, texture coordinate and normal indices of a face corner (1-based, 0 if omitted).
+		 * Negative OBJ indices are stored 0-based from the first element of the chunk that contains the face, with
+		 * the matching bit (1 = vertex, 2 = uv, 4 = normal) set in the relative mask, as the chunk does not know its offset.
+		 */
+		struct face_corner
+		{
+			int vertex, uv, normal;
+			unsigned relative;
+		};
+
+		/**
+		 * \brief The elements parsed from a newline-aligned range of an OBJ file.
+		 */
+		struct obj_chunk
+		{
+			const char* begin;
+			const char* end;
+			std::vector<vector3> vertices;
+			std::vector<vector3> normals;
+			std::vector<vector2> uvs;
+			std::vector<face_corner> corners;
+			std::string error;
+		};
+
+		/**
+		 * \brief A vertex with every component rounded to a multiple of the weld tolerance, used to merge nearby vertices.
+		 */
+		struct vertex_key
+		{
+			int64_t components[14];
+		};
+
+		/**
+		 * \brief Header of a binary mesh cache, which is followed by the vertex array and then the index array.
+		 */
+		struct cache_header
+		{
+			char magic[4];
+			uint32_t version;
+			uint32_t vertex_size;
+			uint32_t vertex_count;
+			uint32_t index_count;
+			float weld_tolerance;
+			uint32_t optimized;
+			float acmr_before;
+			float acmr_after;
+			uint64_t source_size;
+			int64_t source_mtime;
+			float lower[4];
+			float upper[4];
+		};
+
+		static const uint32_t cache_version_ = 2;
+		static const unsigned acmr_cache_size_ = 16;
+
 		std::vector<vertex> vertex_list_;
 		std::vector<unsigned> index_list_;
+		std::unique_ptr<file_mapping> cache_;
+		const vertex* vertex_data_;
+		const unsigned* index_data_;
+		unsigned vertex_count_, index_count_;
+		bounding_box bounds_;
+		float weld_tolerance_;
+		unsigned threads_;
+		bool optimize_;
+		float acmr_before_, acmr_after_;
 		bool is_valid_;
 
+		static const size_t min_chunk_size_ = 256 * 1024;
+
+		/**
+		 * \brief Parses an OBJ file, in parallel chunks if the file is large enough, and indexes the resulting vertices.
+		 * \param path The path to the OBJ file
+		 * \return True if the file was parsed successfully, false otherwise
+		 */
 		bool load_from_file(const char* path);
+
+		/**
+		 * \brief Parses the positions, texture coordinates, normals and faces in a chunk of an OBJ file.
+		 * \param chunk The chunk to parse, which receives the parsed elements or an error message
+		 */
+		static void parse_chunk(obj_chunk& chunk);
+
+		/**
+		 * \brief Builds the unindexed vertices of the faces in a chunk, resolving relative indices with the offsets of the chunk.
+		 * \param chunk The chunk whose faces should be converted
+		 * \param offsets The number of positions, texture coordinates and normals in the chunks before this one
+		 * \param vertices The positions of all chunks
+		 * \param uvs The texture coordinates of all chunks
+		 * \param normals The normals of all chunks
+		 * \param out The vertices of the chunk, three per face
+		 * \return True if every index was in range, false otherwise
+		 */
+		static bool pack_chunk(const obj_chunk& chunk, const size_t* offsets, const std::vector<vector3>& vertices,
+		                       const std::vector<vector2>& uvs, const std::vector<vector3>& normals, vertex* out);
+
+		/**
+		 * \brief Runs a job once for every index in [0, count) on its own thread, and blocks until all jobs have finished.
+		 * \param count The number of jobs
+		 * \param job The function to run for each job index
+		 */
+		static void run_parallel(size_t count, const std::function<void(size_t)>& job);
+
+		/**
+		 * \brief Reorders the faces for post-transform vertex cache reuse, then renumbers the vertices in order of first use.
+		 */
+		void optimize_vertex_cache();
+
+		/**
+		 * \brief Orders faces using the Tipsify algorithm (Sander et al. 2007), which fans around recently used vertices
+		 * and prefers those that are still in the cache and have few faces left.
+		 * \param indices The faces to reorder, three indices per face
+		 * \param vertex_count The number of vertices referenced by the faces
+		 * \param cache_size The number of vertices in the simulated cache
+		 * \return The reordered faces
+		 */
+		static std::vector<unsigned> tipsify(const std::vector<unsigned>& indices, unsigned vertex_count, unsigned cache_size);
+
+		/**
+		 * \brief Maps the binary cache of an OBJ file, if one exists which was built from the current version of the file.
+		 * \param path The path to the OBJ file
+		 * \return True if the mesh was loaded from the cache, false if it must be parsed
+		 */
+		bool load_from_cache(const char* path);
+
+		/**
+		 * \brief Writes the parsed mesh to a binary cache next to the OBJ file, stamped with the size and modification time of the file.
+		 * \param path The path to the OBJ file
+		 * \return True if the cache was written, false otherwise
+		 */
+		bool write_cache(const char* path) const;
+
+		/**
+		 * \brief Gets the path of the binary cache of an OBJ file.
+		 * \param path The path to the OBJ file
+		 * \return The path of the cache
+		 */
+		static std::string cache_path(const char* path) { return std::string(path) + ".mesh"; }
+
+		/**
+		 * \brief Merges identical vertices (or vertices within the weld tolerance) and builds the index list.
+		 * \param in_vertices The unindexed vertices, three per face
+		 * \return True if any faces were indexed, false otherwise
+		 */
 		bool find_indices(std::vector<vertex>& in_vertices);
 
+		/**
+		 * \brief Hashes a block of memory one 32-bit word at a time.
+		 * \param data The memory to hash, which must be a multiple of 4 bytes in size
+		 * \param size The size of the memory in bytes
+		 * \return The hash of the memory
+		 */
+		static uint32_t hash_words(const void* data, size_t size);
+
+		/**
+		 * \brief Rounds every component of a vertex to the nearest multiple of a tolerance.
+		 * \param v The vertex to quantize
+		 * \param tolerance The distance between quantization steps
+		 * \return The quantized vertex
+		 */
+		static vertex_key quantize(const vertex& v, float tolerance);
+
+		/**
+		 * \brief Reads an entire file into memory in a single read, followed by a null terminator.
+		 * \param path The path to the file
+		 * \param buffer The buffer to read the file into
+		 * \return True if the file was read, false otherwise
+		 */
+		static bool read_file(const char* path, std::vector<char>& buffer);
+
+		/**
+		 * \brief Parses a decimal floating point number, skipping leading spaces but not line breaks.
+		 * Numbers with more significant digits or larger exponents than can be converted exactly fall back to strtof.
+		 * \param cursor The position to start parsing from, which is moved past the number on success
+		 * \param value The parsed value
+		 * \return True if a number was parsed, false otherwise
+		 */
+		static bool parse_float(const char*& cursor, float& value);
+
+		/**
+		 * \brief Parses an OBJ index, which may be negative to count backwards from the last element defined so far.
+		 * \param cursor The position to start parsing from, which is moved past the index on success
+		 * \param count The number of elements defined so far in the current chunk
+		 * \param index The parsed index, 1-based if positive and otherwise 0-based from the start of the chunk
+		 * \param relative Whether the index is relative to the start of the chunk
+		 * \return True if a non-zero index was parsed, false otherwise
+		 */
+		static bool parse_index(const char*& cursor, size_t count, int& index, bool& relative);
+
+		/**
+		 * \brief Parses a face corner of the form "v", "v/vt", "v//vn" or "v/vt/vn".
+		 * \param cursor The position to start parsing from, which is moved past the corner on success
+		 * \param counts The number of positions, texture coordinates and normals defined so far in the current chunk
+		 * \param corner The parsed corner
+		 * \return True if a corner was parsed, false otherwise
+		 */
+		static bool parse_corner(const char*& cursor, const size_t* counts, face_corner& corner);
+
 	public:
 
 		/**
 		 * \brief Creates a new Object Loader instance.
 		 * \param path The path to the specific OBJ file that should be loaded
+		 * \param weld_tolerance Vertices whose components round to the same multiple of this value are merged (0 = only identical vertices)
+		 * \param use_cache Whether to load the mesh from a binary cache when it is up to date, and to write one after parsing otherwise
+		 * \param threads The maximum number of threads used to parse large files (0 = hardware concurrency, 1 = serial)
+		 * \param optimize Whether to reorder faces and vertices for vertex cache reuse and locality
 		 */
-		explicit object_loader(const char* path);
+		explicit object_loader(const char* path, float weld_tolerance = 0, bool use_cache = true, unsigned threads = 0, bool optimize = false);
 
 		/**
 		 * \brief Returns whether or not the loader contains valid data.
@@ -35,12 +237,65 @@ namespace efiilj
 		 */
 		bool is_valid() const { return is_valid_; }
 
-		std::vector<vertex> get_vertices() const { return vertex_list_; }
-		std::vector<unsigned> get_indices() const { return index_list_; }
-		
-		int vertex_count() const { return vertex_list_.size(); }
-		int index_count() const { return index_list_.size(); }
+		std::vector<vertex> get_vertices() const { return std::vector<vertex>(vertex_data_, vertex_data_ + vertex_count_); }
+		std::vector<unsigned> get_indices() const { return std::vector<unsigned>(index_data_, index_data_ + index_count_); }
 
-		mesh_resource get_resource();
+		/**
+		 * \brief Packs the loaded vertices within the mesh bounds, using less than half the memory of get_vertices().
+		 * \return A list of packed vertices, which are decoded with bounds()
+		 */
+		std::vector<packed_vertex> get_packed_vertices() const;
+
+		/**
+		 * \brief Gets the loaded vertices without copying them, which point into the mapped cache if the mesh was cached.
+		 * \return A pointer to the first vertex, valid for the lifetime of the loader
+		 */
+		const vertex* vertex_data() const { return vertex_data_; }
+
+		/**
+		 * \brief Gets the loaded indices without copying them, which point into the mapped cache if the mesh was cached.
+		 * \return A pointer to the first index, valid for the lifetime of the loader
+		 */
+		const unsigned* index_data() const { return index_data_; }
+
+		int vertex_count() const { return vertex_count_; }
+		int index_count() const { return index_count_; }
+
+		/**
+		 * \brief Returns whether or not the mesh was loaded from a binary cache instead of being parsed.
+		 * \return True if the mesh was cached, false otherwise
+		 */
+		bool is_cached() const { return cache_ != nullptr; }
+
+		const bounding_box& bounds() const { return bounds_; }
+
+		/**
+		 * \brief Gets the average cache miss ratio (transformed vertices per face) of the faces in file order, with a 16 entry FIFO cache.
+		 * \return The ACMR of the mesh before optimization
+		 */
+		float acmr_before() const { return acmr_before_; }
+
+		/**
+		 * \brief Gets the average cache miss ratio of the loaded faces, which differs from acmr_before() if the mesh was optimized.
+		 * \return The ACMR of the mesh after optimization
+		 */
+		float acmr_after() const { return acmr_after_; }
+
+		/**
+		 * \brief Simulates a FIFO post-transform vertex cache, and counts the vertices transformed per face.
+		 * \param indices The faces to simulate, three indices per face
+		 * \param index_count The number of indices
+		 * \param vertex_count The number of vertices referenced by the faces
+		 * \param cache_size The number of vertices in the cache
+		 * \return The average cache miss ratio, from 0.5 at best for large regular meshes up to 3
+		 */
+		static float get_acmr(const unsigned* indices, size_t index_count, unsigned vertex_count, unsigned cache_size);
+
+		/**
+		 * \brief Creates a GPU mesh from the loaded vertices and indices.
+		 * \param packed Whether to store the vertices as packed vertices, which must be drawn with a shader which decodes them
+		 * \return A new mesh resource
+		 */
+		mesh_resource get_resource(bool packed = false);
 	};
 }
@@ -0,0 +1,101 @@
+#include "mapping.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace efiilj
+{
+#ifdef _WIN32
+	file_mapping::file_mapping(const char* path)
+		: data_(nullptr), size_(0), file_(INVALID_HANDLE_VALUE), mapping_(nullptr)
+	{
+		file_ = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file_ == INVALID_HANDLE_VALUE)
+			return;
+
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(file_, &size) || size.QuadPart == 0)
+			return;
+
+		mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mapping_ == nullptr)
+			return;
+
+		data_ = static_cast<const unsigned char*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+		size_ = data_ != nullptr ? static_cast<size_t>(size.QuadPart) : 0;
+	}
+
+	file_mapping::~file_mapping()
+	{
+		if (data_ != nullptr)
+			UnmapViewOfFile(data_);
+
+		if (mapping_ != nullptr)
+			CloseHandle(mapping_);
+
+		if (file_ != INVALID_HANDLE_VALUE)
+			CloseHandle(file_);
+	}
+
+	bool file_mapping::get_stamp(const char* path, uint64_t& size, int64_t& mtime)
+	{
+		struct _stat64 info;
+		if (_stat64(path, &info) != 0)
+			return false;
+
+		size = static_cast<uint64_t>(info.st_size);
+		mtime = static_cast<int64_t>(info.st_mtime);
+		return true;
+	}
+#else
+	file_mapping::file_mapping(const char* path)
+		: data_(nullptr), size_(0)
+	{
+		const int file = open(path, O_RDONLY);
+		if (file < 0)
+			return;
+
+		struct stat info;
+		if (fstat(file, &info) == 0 && info.st_size > 0)
+		{
+			void* data = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+
+			if (data != MAP_FAILED)
+			{
+				data_ = static_cast<const unsigned char*>(data);
+				size_ = static_cast<size_t>(info.st_size);
+			}
+		}
+
+		// The mapping keeps its own reference to the file
+		close(file);
+	}
+
+	file_mapping::~file_mapping()
+	{
+		if (data_ != nullptr)
+			munmap(const_cast<unsigned char*>(data_), size_);
+	}
+
+	bool file_mapping::get_stamp(const char* path, uint64_t& size, int64_t& mtime)
+	{
+		struct stat info;
+		if (stat(path, &info) != 0)
+			return false;
+
+		size = static_cast<uint64_t>(info.st_size);
+		mtime = static_cast<int64_t>(info.st_mtime);
+		return true;
+	}
+#endif
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace efiilj
+{
+	/**
+	 * \brief A read-only view of an entire file, mapped into memory so that its contents are paged in on demand.
+	 */
+	class file_mapping
+	{
+	private:
+
+		const unsigned char* data_;
+		size_t size_;
+
+#ifdef _WIN32
+		void* file_;
+		void* mapping_;
+#endif
+
+	public:
+
+		/**
+		 * \brief Maps a file into memory.
+		 * \param path The path to the file which should be mapped
+		 */
+		explicit file_mapping(const char* path);
+		~file_mapping();
+
+		file_mapping(const file_mapping&) = delete;
+		file_mapping& operator = (const file_mapping&) = delete;
+
+		/**
+		 * \brief Returns whether or not the file was mapped successfully.
+		 * \return True if the file is mapped, false otherwise
+		 */
+		bool is_valid() const { return data_ != nullptr; }
+
+		const unsigned char* data() const { return data_; }
+		size_t size() const { return size_; }
+
+		/**
+		 * \brief Gets the size and last modification time of a file, without opening it.
+		 * \param path The path to the file
+		 * \param size The size of the file in bytes
+		 * \param mtime The last modification time of the file, in seconds since the epoch
+		 * \return True if the file exists, false otherwise
+		 */
+		static bool get_stamp(const char* path, uint64_t& size, int64_t& mtime);
+	};
+}
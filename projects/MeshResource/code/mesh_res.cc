@@ -1,15 +1,24 @@
 #include "mesh_res.h"
+#include "loader.h"
 
 #include <GL/glew.h>
 
 namespace efiilj
 {
-	mesh_resource::mesh_resource() : vbo_(0), ibo_(0), vao_(0), vertex_count_(0), index_count_(0)
+	mesh_resource::mesh_resource() : vbo_(0), ibo_(0), vao_(0), vertex_count_(0), index_count_(0), packed_(false)
 	{
 	}
 
 	mesh_resource::
-	mesh_resource(vertex* vertex_list, const int vertex_count, unsigned int* index_list, const int index_count) : vbo_(0), ibo_(0), vao_(0)
+	mesh_resource(const vertex* vertex_list, const int vertex_count, const unsigned int* index_list, const int index_count)
+		: mesh_resource(vertex_list, vertex_count, index_list, index_count, bounding_box(vertex_list, vertex_count))
+	{
+	}
+
+	mesh_resource::
+	mesh_resource(const vertex* vertex_list, const int vertex_count, const unsigned int* index_list, const int index_count,
+	              const bounding_box& bounds, const bool packed)
+		: vbo_(0), ibo_(0), vao_(0), bounds_(bounds), packed_(packed)
 	{
 		this->vertex_count_ = vertex_count;
 		this->index_count_ = index_count;
@@ -74,19 +83,34 @@ namespace efiilj
 		return mesh_resource(vertices, 24, indices, 36);
 	}
 
-	void mesh_resource::init_vertex_buffer(vertex* vertex_list, const int count)
+	void mesh_resource::init_vertex_buffer(const vertex* vertex_list, const int count)
 	{
 		if (vbo_ != 0)
 			return;
 
 		glGenBuffers(1, &vbo_);
 		glBindBuffer(GL_ARRAY_BUFFER, vbo_);
-		glBufferData(GL_ARRAY_BUFFER, count * sizeof(vertex), vertex_list, GL_STATIC_DRAW);
 
-		glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(vertex), nullptr);
-		glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(vertex), reinterpret_cast<void*>(offsetof(vertex, normal)));
-		glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(vertex), reinterpret_cast<void*>(offsetof(vertex, rgba)));
-		glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(vertex), reinterpret_cast<void*>(offsetof(vertex, uv)));
+		if (packed_)
+		{
+			const std::vector<packed_vertex> packed = pack_vertices(vertex_list, count);
+			glBufferData(GL_ARRAY_BUFFER, count * sizeof(packed_vertex), packed.data(), GL_STATIC_DRAW);
+
+			// Positions are normalized to [0, 1] within the bounds (w defaults to 1), and normals to [-1, 1] on the octahedron
+			glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(packed_vertex), reinterpret_cast<void*>(offsetof(packed_vertex, pos)));
+			glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(packed_vertex), reinterpret_cast<void*>(offsetof(packed_vertex, normal)));
+			glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(packed_vertex), reinterpret_cast<void*>(offsetof(packed_vertex, rgba)));
+			glVertexAttribPointer(3, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(packed_vertex), reinterpret_cast<void*>(offsetof(packed_vertex, uv)));
+		}
+		else
+		{
+			glBufferData(GL_ARRAY_BUFFER, count * sizeof(vertex), vertex_list, GL_STATIC_DRAW);
+
+			glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(vertex), nullptr);
+			glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(vertex), reinterpret_cast<void*>(offsetof(vertex, normal)));
+			glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(vertex), reinterpret_cast<void*>(offsetof(vertex, rgba)));
+			glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(vertex), reinterpret_cast<void*>(offsetof(vertex, uv)));
+		}
 
 		glEnableVertexAttribArray(0);
 		glEnableVertexAttribArray(1);
@@ -94,7 +118,17 @@ namespace efiilj
 		glEnableVertexAttribArray(3);
 	}
 
-	void mesh_resource::init_index_buffer(unsigned int* index_list, const int count)
+	std::vector<packed_vertex> mesh_resource::pack_vertices(const vertex* vertex_list, const int count) const
+	{
+		std::vector<packed_vertex> packed(count);
+
+		for (int i = 0; i < count; i++)
+			packed[i] = packed_vertex::pack(vertex_list[i], bounds_);
+
+		return packed;
+	}
+
+	void mesh_resource::init_index_buffer(const unsigned int* index_list, const int count)
 	{
 		if (ibo_ != 0)
 			return;
@@ -113,10 +147,22 @@ namespace efiilj
 		glBindVertexArray(vao_);
 	}
 
-	void mesh_resource::update_vertex_buffer(vertex* vertex_list) const
+	void mesh_resource::update_vertex_buffer(vertex* vertex_list)
 	{
+		bounds_ = bounding_box(vertex_list, vertex_count_);
+
 		glBindBuffer(GL_ARRAY_BUFFER, vbo_);
-		glBufferSubData(GL_ARRAY_BUFFER, 0, vertex_count_ * sizeof(vertex), vertex_list);
+
+		if (packed_)
+		{
+			// The vertices are packed within the new bounds, which also changes the decode matrix
+			const std::vector<packed_vertex> packed = pack_vertices(vertex_list, vertex_count_);
+			glBufferSubData(GL_ARRAY_BUFFER, 0, vertex_count_ * sizeof(packed_vertex), packed.data());
+		}
+		else
+		{
+			glBufferSubData(GL_ARRAY_BUFFER, 0, vertex_count_ * sizeof(vertex), vertex_list);
+		}
 	}
 
 	void mesh_resource::bind() const
@@ -145,4 +191,10 @@ namespace efiilj
 		glDeleteBuffers(1, &vbo_);
 		glDeleteBuffers(1, &ibo_);
 	}
+
+	// Defined with the mesh resource rather than the loader, so that loading meshes does not require OpenGL
+	mesh_resource object_loader::get_resource(const bool packed)
+	{
+		return mesh_resource(vertex_data_, vertex_count(), index_data_, index_count(), bounds_, packed);
+	}
 }
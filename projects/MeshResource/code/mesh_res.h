@@ -1,6 +1,10 @@
 #pragma once
 
 #include "vertex.h"
+#include "bounds.h"
+#include "packed.h"
+
+#include <vector>
 
 namespace efiilj
 {
@@ -28,20 +32,31 @@ namespace efiilj
 		int vertex_count_;
 		int index_count_;
 
+		bounding_box bounds_;
+		bool packed_;
+
 		/**
 		 * \brief Creates and initializes the Vertex Buffer, configures vertex attribute pointers, and enables attribute arrays.
 		 *  Ensure a Vertex Array Object has been configured and bound before running this function.
 		 * \param vertex_list The list of vertices to buffer
 		 * \param count Size of vertex list
 		 */
-		void init_vertex_buffer(vertex* vertex_list, int count);
+		void init_vertex_buffer(const vertex* vertex_list, int count);
+
+		/**
+		 * \brief Packs a vertex list within the mesh bounds, for upload to a packed vertex buffer.
+		 * \param vertex_list The list of vertices to pack
+		 * \param count Size of vertex list
+		 * \return The packed vertex list
+		 */
+		std::vector<packed_vertex> pack_vertices(const vertex* vertex_list, int count) const;
 
 		/**
 		 * \brief Creates and initializes the Index Buffer.
 		 * \param index_list The list of indices to buffer
 		 * \param count Size of index list
 		 */
-		void init_index_buffer(unsigned int* index_list, int count);
+		void init_index_buffer(const unsigned int* index_list, int count);
 
 		/**
 		 * \brief Creates and initializes the Vertex Array Object.
@@ -62,7 +77,19 @@ namespace efiilj
 		 * \param index_list List of indices to buffer
 		 * \param index_count Size of the index list
 		 */
-		mesh_resource(vertex* vertex_list, int vertex_count, unsigned int* index_list, int index_count);
+		mesh_resource(const vertex* vertex_list, int vertex_count, const unsigned int* index_list, int index_count);
+
+		/**
+		 * \brief Creates a new MeshResource instance with the specified vertex and index lists, and bounds which are already known.
+		 * \param vertex_list List of vertices to buffer
+		 * \param vertex_count Size of the vertex list
+		 * \param index_list List of indices to buffer
+		 * \param index_count Size of the index list
+		 * \param bounds The bounding box of the vertex list
+		 * \param packed Whether to store the vertices as packed vertices on the GPU, which must then be drawn with a shader which decodes them
+		 */
+		mesh_resource(const vertex* vertex_list, int vertex_count, const unsigned int* index_list, int index_count, const bounding_box& bounds,
+		              bool packed = false);
 
 		mesh_resource(mesh_resource& copy)
 			= default;
@@ -96,6 +123,34 @@ namespace efiilj
 			return index_count_;
 		}
 
+		/**
+		 * \brief Gets the object-space bounding box of the mesh vertices
+		 * \returns The bounding box enclosing the mesh
+		 */
+		const bounding_box& bounds() const
+		{
+			return bounds_;
+		}
+
+		/**
+		 * \brief Gets whether the vertex buffer holds packed vertices
+		 * \returns True if the vertices are packed, false if they are stored as full vertices
+		 */
+		bool is_packed() const
+		{
+			return packed_;
+		}
+
+		/**
+		 * \brief Gets the matrix which maps the normalized positions of packed vertices into object-space,
+		 *  which shaders drawing a packed mesh receive as uniform "u_decode"
+		 * \returns The decode matrix of the mesh bounds
+		 */
+		matrix4 decode() const
+		{
+			return packed_vertex::get_decode(bounds_);
+		}
+
 		/**
 		 * \brief Binds Vertex Array Object and Index Buffer to prepare OpenGL for drawing this mesh.
 		 */
@@ -107,10 +162,10 @@ namespace efiilj
 		static void unbind();
 
 		/**
-		 * \brief Pushes a new vertex list (of the same size) to the Vertex Buffer.
+		 * \brief Pushes a new vertex list (of the same size) to the Vertex Buffer, and updates the bounding box.
 		 * \param vertex_list The updated vertex list
 		 */
-		void update_vertex_buffer(vertex* vertex_list) const;
+		void update_vertex_buffer(vertex* vertex_list);
 
 		/**
 		 * \brief Performs a draw call with the correct index specifications.
@@ -31,12 +31,26 @@ namespace efiilj
 		shader_->drop();
 	}
 
-	void graphics_node::draw() const
+	bool graphics_node::is_visible() const
 	{
+		return view_frustum(camera_->view_perspective() * transform_->model()).intersects(mesh_->bounds());
+	}
+
+	bool graphics_node::draw() const
+	{
+		if (!is_visible())
+			return false;
+
 		bind();
 		shader_->set_uniform("u_camera", camera_->view_perspective());
 		shader_->set_uniform("u_model", transform_->model());
+
+		if (mesh_->is_packed())
+			shader_->set_uniform("u_decode", mesh_->decode());
+
 		mesh_->draw_elements();
 		unbind();
+
+		return true;
 	}
 }
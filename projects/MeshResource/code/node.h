@@ -65,8 +65,17 @@ namespace efiilj
 		 */
 		void unbind() const;
 		/**
-		 * \brief Performs a draw call. View/perspective + model matrices are pushed shader uniforms "u_camera" and "u_model" respectively.
+		 * \brief Tests the mesh bounding box against the camera view frustum.
+		 * \return True if the node may be visible, false if it lies entirely outside the frustum
 		 */
-		void draw() const;
+		bool is_visible() const;
+
+		/**
+		 * \brief Performs a draw call, unless the node lies outside the camera view frustum.
+		 * View/perspective + model matrices are pushed shader uniforms "u_camera" and "u_model" respectively,
+		 * and for packed meshes the position decode matrix as "u_decode".
+		 * \return True if the node was drawn, false if it was culled
+		 */
+		bool draw() const;
 	};
 }
@@ -0,0 +1,175 @@
+#include "packed.h"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+namespace efiilj
+{
+	namespace
+	{
+		const float position_scale = 65535.0f;
+		const float normal_scale = 32767.0f;
+		const float color_scale = 255.0f;
+
+		float sign_of(const float value)
+		{
+			return value >= 0 ? 1.0f : -1.0f;
+		}
+
+		float extent_of(const bounding_box& bounds, const int axis)
+		{
+			const float extent = bounds.upper.at(axis) - bounds.lower.at(axis);
+			return extent > 0 ? extent : 0;
+		}
+
+		/**
+		 * \brief Rounds a value to the nearest integer after clamping it to a range.
+		 */
+		long quantize(const float value, const float low, const float high)
+		{
+			return std::lround(std::min(std::max(value, low), high));
+		}
+	}
+
+	packed_vertex packed_vertex::pack(const vertex& vert, const bounding_box& bounds)
+	{
+		packed_vertex packed;
+
+		for (int i = 0; i < 3; i++)
+		{
+			const float extent = extent_of(bounds, i);
+			const float t = extent > 0 ? (vert.xyzw.at(i) - bounds.lower.at(i)) / extent : 0;
+			packed.pos[i] = static_cast<uint16_t>(quantize(t * position_scale, 0, position_scale));
+		}
+
+		packed.pos[3] = 0;
+
+		// Project the normal onto the octahedron |x| + |y| + |z| = 1, and fold the lower half over the upper
+		const float x = vert.normal.x(), y = vert.normal.y(), z = vert.normal.z();
+		const float length = std::fabs(x) + std::fabs(y) + std::fabs(z);
+
+		float u = length > 0 ? x / length : 0;
+		float v = length > 0 ? y / length : 0;
+
+		if (z < 0)
+		{
+			const float folded_u = (1 - std::fabs(v)) * sign_of(u);
+			v = (1 - std::fabs(u)) * sign_of(v);
+			u = folded_u;
+		}
+
+		packed.normal[0] = static_cast<int16_t>(quantize(u * normal_scale, -normal_scale, normal_scale));
+		packed.normal[1] = static_cast<int16_t>(quantize(v * normal_scale, -normal_scale, normal_scale));
+
+		packed.uv[0] = to_half(vert.uv.x());
+		packed.uv[1] = to_half(vert.uv.y());
+
+		for (int i = 0; i < 4; i++)
+			packed.rgba[i] = static_cast<uint8_t>(quantize(vert.rgba.at(i) * color_scale, 0, color_scale));
+
+		return packed;
+	}
+
+	vertex packed_vertex::unpack(const bounding_box& bounds) const
+	{
+		vertex vert;
+
+		vert.xyzw = vector4(
+			bounds.lower.at(0) + pos[0] / position_scale * extent_of(bounds, 0),
+			bounds.lower.at(1) + pos[1] / position_scale * extent_of(bounds, 1),
+			bounds.lower.at(2) + pos[2] / position_scale * extent_of(bounds, 2),
+			1);
+
+		// Matches the conversion of normalized signed integers in OpenGL
+		float x = std::max(normal[0] / normal_scale, -1.0f);
+		float y = std::max(normal[1] / normal_scale, -1.0f);
+		const float z = 1 - std::fabs(x) - std::fabs(y);
+
+		if (z < 0)
+		{
+			const float unfolded_x = (1 - std::fabs(y)) * sign_of(x);
+			y = (1 - std::fabs(x)) * sign_of(y);
+			x = unfolded_x;
+		}
+
+		const float length = std::sqrt(x * x + y * y + z * z);
+		vert.normal = vector4(x / length, y / length, z / length, 1);
+
+		vert.uv = vector2(from_half(uv[0]), from_half(uv[1]));
+		vert.rgba = vector4(rgba[0] / color_scale, rgba[1] / color_scale, rgba[2] / color_scale, rgba[3] / color_scale);
+
+		return vert;
+	}
+
+	matrix4 packed_vertex::get_decode(const bounding_box& bounds)
+	{
+		return matrix4::get_translation(bounds.lower.at(0), bounds.lower.at(1), bounds.lower.at(2))
+			* matrix4::get_scale(extent_of(bounds, 0), extent_of(bounds, 1), extent_of(bounds, 2));
+	}
+
+	uint16_t packed_vertex::to_half(const float value)
+	{
+		uint32_t bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+
+		const uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+		const uint32_t magnitude = bits & 0x7fffffff;
+
+		// Infinity and NaN, keeping NaN quiet
+		if (magnitude >= 0x7f800000)
+			return sign | 0x7c00 | (magnitude > 0x7f800000 ? 0x200 : 0);
+
+		// At least 65520, which rounds past the largest half (65504)
+		if (magnitude >= 0x477ff000)
+			return sign | 0x7c00;
+
+		// Below the smallest normal half (2^-14), round the mantissa into a denormal
+		if (magnitude < 0x38800000)
+		{
+			if (magnitude < 0x33000000)
+				return sign;
+
+			const uint32_t mantissa = (magnitude & 0x7fffff) | 0x800000;
+			const uint32_t shift = 126 - (magnitude >> 23);
+			const uint32_t half = 1u << (shift - 1);
+			const uint32_t rest = mantissa & ((1u << shift) - 1);
+
+			uint32_t result = mantissa >> shift;
+			if (rest > half || (rest == half && (result & 1)))
+				result++;
+
+			return sign | static_cast<uint16_t>(result);
+		}
+
+		// Rebias the exponent from 127 to 15 and round to nearest even, letting a mantissa overflow carry into the exponent
+		uint32_t result = (magnitude - (112u << 23)) >> 13;
+		const uint32_t rest = magnitude & 0x1fff;
+
+		if (rest > 0x1000 || (rest == 0x1000 && (result & 1)))
+			result++;
+
+		return sign | static_cast<uint16_t>(result);
+	}
+
+	float packed_vertex::from_half(const uint16_t half)
+	{
+		const uint32_t sign = static_cast<uint32_t>(half & 0x8000) << 16;
+		const uint32_t exponent = (half >> 10) & 0x1f;
+		const uint32_t mantissa = half & 0x3ff;
+
+		if (exponent == 0)
+		{
+			const float value = std::ldexp(static_cast<float>(mantissa), -24);
+			return sign != 0 ? -value : value;
+		}
+
+		const uint32_t bits = exponent == 31
+			? sign | 0x7f800000 | (mantissa << 13)
+			: sign | ((exponent + 112) << 23) | (mantissa << 13);
+
+		float value;
+		std::memcpy(&value, &bits, sizeof(value));
+		return value;
+	}
+}
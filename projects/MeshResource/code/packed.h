@@ -0,0 +1,71 @@
+#pragma once
+
+#include "vertex.h"
+#include "bounds.h"
+
+#include <cstdint>
+
+namespace efiilj
+{
+	/**
+	 * \brief A compact vertex, 20 bytes instead of the 56 of a vertex.
+	 * Positions are stored as 16-bit fractions of the mesh bounding box, normals as two 16-bit octahedral coordinates,
+	 * colors as 8-bit fractions, and texture coordinates as half-precision floats.
+	 * Decoding needs the bounding box the vertex was packed with.
+	 */
+	struct packed_vertex
+	{
+		/**
+		 * \brief Position within the bounding box, from 0 at the lower corner to 65535 at the upper (the fourth component is unused).
+		 */
+		uint16_t pos[4];
+		/**
+		 * \brief Normal direction, encoded onto an octahedron and unfolded onto a square from -32767 to 32767.
+		 */
+		int16_t normal[2];
+		/**
+		 * \brief Texture coordinates as IEEE 754 half-precision floats.
+		 */
+		uint16_t uv[2];
+		/**
+		 * \brief Color, from 0 to 255 per channel.
+		 */
+		uint8_t rgba[4];
+
+		/**
+		 * \brief Packs a vertex.
+		 * \param vert The vertex which should be packed
+		 * \param bounds The bounding box of the mesh, which must enclose the vertex
+		 * \return The packed vertex
+		 */
+		static packed_vertex pack(const vertex& vert, const bounding_box& bounds);
+
+		/**
+		 * \brief Decodes the vertex. The position and normal get w = 1, and the normal is unit length.
+		 * \param bounds The bounding box the vertex was packed with
+		 * \return The decoded vertex
+		 */
+		vertex unpack(const bounding_box& bounds) const;
+
+		/**
+		 * \brief Gets the matrix which maps the packed positions of a mesh, as normalized values from 0 to 1, into object-space.
+		 * \param bounds The bounding box the vertices were packed with
+		 * \return A matrix which scales by the size of the bounding box, then translates to its lower corner
+		 */
+		static matrix4 get_decode(const bounding_box& bounds);
+
+		/**
+		 * \brief Converts a float to half precision, rounding to the nearest value.
+		 * \param value The value to convert
+		 * \return The bits of the half-precision float
+		 */
+		static uint16_t to_half(float value);
+
+		/**
+		 * \brief Converts a half-precision float to a float.
+		 * \param half The bits of the half-precision float
+		 * \return The value of the half-precision float
+		 */
+		static float from_half(uint16_t half);
+	};
+}
@@ -4,32 +4,82 @@ namespace efiilj
 {
 
 	transform_model::transform_model(const vector3& pos, const vector3& rot, const vector3& scale)
-	: model_(true), position(pos, 1), scale(scale, 1), rotation(rot, 1) { }
-	
-	const matrix4& transform_model::model()
+	: position_(pos, 1), scale_(scale, 1), rotation_(rot, 1), model_(true), inverse_(true), normal_(true), dirty_(true) { }
+
+	void transform_model::update() const
 	{
-		//TODO: Optimize transform model function.
-		const matrix4 t = matrix4::get_translation(position);
-		const matrix4 r = matrix4::get_rotation_xyz(rotation);
-		const matrix4 s = matrix4::get_scale(scale);
+		if (!dirty_)
+			return;
+
+		const float sin_x = sinf(rotation_.x()), cos_x = cosf(rotation_.x());
+		const float sin_y = sinf(rotation_.y()), cos_y = cosf(rotation_.y());
+		const float sin_z = sinf(rotation_.z()), cos_z = cosf(rotation_.z());
+
+		// Rows of the rotation Rz * Ry * Rx, written out instead of multiplying the three axis rotations
+		const float r[3][3] =
+		{
+			{ cos_z * cos_y, (cos_z * sin_y) * sin_x - sin_z * cos_x, (cos_z * sin_y) * cos_x + sin_z * sin_x },
+			{ sin_z * cos_y, (sin_z * sin_y) * sin_x + cos_z * cos_x, (sin_z * sin_y) * cos_x - cos_z * sin_x },
+			{ -sin_y, cos_y * sin_x, cos_y * cos_x }
+		};
+
+		const float s[3] = { scale_.x(), scale_.y(), scale_.z() };
+		const float t[3] = { position_.x(), position_.y(), position_.z() };
+
+		// T * R * S scales the columns of the rotation, and puts the translation in the last column
+		model_ = matrix4(
+			vector4(r[0][0] * s[0], r[0][1] * s[1], r[0][2] * s[2], t[0]),
+			vector4(r[1][0] * s[0], r[1][1] * s[1], r[1][2] * s[2], t[1]),
+			vector4(r[2][0] * s[0], r[2][1] * s[1], r[2][2] * s[2], t[2]),
+			vector4(0, 0, 0, 1));
+
+		// (T * R * S)^-1 = S^-1 * R^T * T^-1, as the rotation is orthonormal
+		if (s[0] != 0 && s[1] != 0 && s[2] != 0)
+		{
+			vector4 rows[3];
+
+			for (int i = 0; i < 3; i++)
+			{
+				const float x = r[0][i] / s[i], y = r[1][i] / s[i], z = r[2][i] / s[i];
+				rows[i] = vector4(x, y, z, -(x * t[0] + y * t[1] + z * t[2]));
+			}
 
-		model_ = t * r * s;
-		
+			inverse_ = matrix4(rows[0], rows[1], rows[2], vector4(0, 0, 0, 1));
+		}
+		else
+		{
+			// A zero scale leaves the model matrix singular, so like matrix4::inverse() the inverse falls back to an identity
+			inverse_ = matrix4();
+		}
+
+		normal_ = inverse_.transpose();
+		dirty_ = false;
+	}
+
+	const matrix4& transform_model::model() const
+	{
+		update();
 		return model_;
 	}
 
-	const matrix4& transform_model::model_inv()
+	const matrix4& transform_model::model_inv() const
 	{
-		inverse_ = model_.inverse();
+		update();
 		return inverse_;
 	}
 
+	const matrix4& transform_model::normal() const
+	{
+		update();
+		return normal_;
+	}
+
 	vector4 transform_model::forward() const
 	{
 		return vector4(
-			cos(rotation.x()) * cos(rotation.y()),
-			sin(rotation.x()),
-			cos(rotation.x()) * sin(rotation.y()), 1).norm();
+			cos(rotation_.x()) * cos(rotation_.y()),
+			sin(rotation_.x()),
+			cos(rotation_.x()) * sin(rotation_.y()), 1).norm();
 	}
 
 	vector4 transform_model::backward() const
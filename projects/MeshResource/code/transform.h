@@ -11,8 +11,19 @@ namespace efiilj
 	{
 	private:
 
-		matrix4 model_;
-		matrix4 inverse_;
+		vector4 position_;
+		vector4 scale_;
+		vector4 rotation_;
+
+		mutable matrix4 model_;
+		mutable matrix4 inverse_;
+		mutable matrix4 normal_;
+		mutable bool dirty_;
+
+		/**
+		 * \brief Rebuilds the model, inverse and normal matrices if the position, rotation or scale changed since they were last built.
+		 */
+		void update() const;
 
 	public:
 
@@ -25,18 +36,33 @@ namespace efiilj
 		explicit transform_model(const vector3& pos = vector3(0, 0, 0), const vector3& rot = vector3(0, 0, 0),
 		                         const vector3& scale = vector3(1, 1, 1));
 
+		const vector4& position() const { return position_; }
+		void position(const vector4& xyz) { position_ = xyz; dirty_ = true; }
+
+		const vector4& rotation() const { return rotation_; }
+		void rotation(const vector4& xyz) { rotation_ = xyz; dirty_ = true; }
 
-		vector4 position;
-		vector4 scale;
-		vector4 rotation;
+		const vector4& scale() const { return scale_; }
+		void scale(const vector4& xyz) { scale_ = xyz; dirty_ = true; }
 
 		/**
-		 * \brief Retrieves a model matrix for the current transform.
+		 * \brief Retrieves a model matrix for the current transform, which is only rebuilt after the transform has changed.
 		 * \return A 4-dimensional matrix which represents the point in 3D-space
 		 */
-		const matrix4& model();
+		const matrix4& model() const;
 
-		const matrix4& model_inv();
+		/**
+		 * \brief Retrieves the inverse of the model matrix, which is only rebuilt after the transform has changed.
+		 * It is built from the inverted translation, rotation and scale, so no general matrix inverse is needed.
+		 * \return A matrix which transforms from world-space into object-space
+		 */
+		const matrix4& model_inv() const;
+
+		/**
+		 * \brief Retrieves the normal matrix (the transposed inverse) of the model matrix, which is only rebuilt after the transform has changed.
+		 * \return A matrix which transforms object-space normals into world-space
+		 */
+		const matrix4& normal() const;
 
 		/**
 		 * \brief Returns a forward vector relative to the current transform
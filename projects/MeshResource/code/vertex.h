@@ -2,6 +2,8 @@
 
 #include "matrix4.h"
 
+#include <cstring>
+
 namespace efiilj
 {
 	
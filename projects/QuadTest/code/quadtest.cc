@@ -9,6 +9,7 @@
 #include "light.h"
 #include "node.h"
 #include "swrast.h"
+#include "swshaders.h"
 #include "bufrend.h"
 #include "color.h"
 
@@ -56,9 +57,10 @@ namespace efiilj
 
 		float fov = nvgDegToRad(75);
 
-		object_loader fox_loader = object_loader("./res/meshes/cat.obj");
+		object_loader fox_loader("./res/meshes/cat.obj", 0, true, 0, true);
 
-		std::string fs = shader_resource::load_shader("./res/shaders/vertex.shader");
+		// The GPU mesh stores packed vertices, which the packed vertex shader decodes
+		std::string fs = shader_resource::load_shader("./res/shaders/vertex_packed.shader");
 		std::string vs = shader_resource::load_shader("./res/shaders/fragment.shader");
 		
 		if (!fox_loader.is_valid())
@@ -68,8 +70,9 @@ namespace efiilj
 		}
 
 		std::cout << "Loaded " << fox_loader.vertex_count() << " vertices, " << fox_loader.index_count() << " indices\n";
+		std::cout << "Vertex cache ACMR " << fox_loader.acmr_before() << " -> " << fox_loader.acmr_after() << "\n";
 
-		mesh_resource fox_model = fox_loader.get_resource();
+		mesh_resource fox_model = fox_loader.get_resource(true);
 		auto fox_mesh_ptr = std::make_shared<mesh_resource>(fox_model);
 		auto fox_texture_ptr = std::make_shared<texture_resource>("./res/textures/fox_base.png", true);
 		auto fox_trans_ptr = std::make_shared<transform_model>(vector3(4, 2, 2), vector3(0), vector3(0.1f, 0.1f, 0.1f));
@@ -85,46 +88,9 @@ namespace efiilj
 
 		/*SOFTWARE RENDERER*/
 		auto rasterizer_ptr = std::make_shared<rasterizer>(1024, 1024, camera_ptr, color(3, 0, 3, 127));
-		auto node_ptr = std::make_shared<rasterizer_node>(fox_loader.get_vertices(), fox_loader.get_indices(), fox_trans_ptr);
 		
-		node_ptr->vertex_shader = [](vertex* vert, const vertex_uniforms& uniforms) -> vertex_data
-		{
-			vertex_data data;
-			data.pos = uniforms.camera * uniforms.model * vert->xyzw;
-			data.uv = vert->uv;
-			data.color = vert->rgba;
-			data.normal = uniforms.normal * vert->normal;
-			data.fragment = (uniforms.model * data.pos);
-
-			return data;
-		};
-
-		node_ptr->fragment_shader = [](const vertex_data& data, const texture_data& texture, const fragment_uniforms& uniforms) -> color
-		{
-			const vector4 col = texture.get_pixel(data.uv);
-
-			const vector4 ambient = uniforms.ambient_color * uniforms.ambient_strength;
-			const vector4 norm = uniforms.normal.norm();
-			const vector4 light_dir = (uniforms.light_position - uniforms.fragment).norm();
-			const vector4 view_dir = (uniforms.camera_position - uniforms.fragment).norm();
-			const vector4 reflect_dir = (light_dir * -1).getReflection(norm);
-
-			const float diff = std::max(vector4::dot(norm, light_dir), 0.0f);
-			const vector4 diffuse = uniforms.light_rgba * diff;
-
-			const float spec = pow(std::max(vector4::dot(view_dir, reflect_dir), 0.0f), uniforms.shininess);
-			const vector4 specular = uniforms.light_rgba * uniforms.specular_strength * spec;
-
-			const vector4 result = (ambient + diffuse + specular) * col;
-			
-			return
-			{
-				static_cast<unsigned char>(result.x()),
-				static_cast<unsigned char>(result.y()),
-				static_cast<unsigned char>(result.z()),
-				static_cast<unsigned char>(result.w())
-			};
-		};
+		// Shaders known at compile time are inlined into the node's shading loops
+		auto node_ptr = make_pipeline_node(fox_loader.get_vertices(), fox_loader.get_indices(), fox_trans_ptr, phong_vertex_shader(), phong_fragment_shader());
 
 		auto tex_ptr = std::make_shared<texture_data>("./res/textures/fox_base.png");
 		node_ptr->texture(tex_ptr);
@@ -170,9 +136,9 @@ namespace efiilj
 				mouse_y_ = y / 1000.0f - 0.5f;
 
 				if (is_mouse_captured_)
-					camera_trans_ptr->rotation = vector4(-mouse_y_, mouse_x_, 0, 1);
+					camera_trans_ptr->rotation(vector4(-mouse_y_, mouse_x_, 0, 1));
 				else if (is_dragging_mouse_)
-					fox_trans_ptr->rotation += vector4(mouse_y_ - mouse_down_y_, mouse_x_ - mouse_down_x_, 0, 1) * 0.5f;
+					fox_trans_ptr->rotation(fox_trans_ptr->rotation() + vector4(mouse_y_ - mouse_down_y_, mouse_x_ - mouse_down_x_, 0, 1) * 0.5f);
 			});
 
 		window_->SetMousePressFunction([&](const int button, const int action, int mods) 
@@ -199,22 +165,22 @@ namespace efiilj
 			this->window_->Update();
 
 			if (keys.find(GLFW_KEY_W) != keys.end())
-				camera_trans_ptr->position+= camera_trans_ptr->forward() * 0.1f;
+				camera_trans_ptr->position(camera_trans_ptr->position() + camera_trans_ptr->forward() * 0.1f);
 			
 			if (keys.find(GLFW_KEY_S) != keys.end())
-				camera_trans_ptr->position -= camera_trans_ptr->forward() * 0.1f;
+				camera_trans_ptr->position(camera_trans_ptr->position() - camera_trans_ptr->forward() * 0.1f);
 			
 			if (keys.find(GLFW_KEY_A) != keys.end())
-				camera_trans_ptr->position += camera_trans_ptr->left() * 0.1f;
+				camera_trans_ptr->position(camera_trans_ptr->position() + camera_trans_ptr->left() * 0.1f);
 			
 			if (keys.find(GLFW_KEY_D) != keys.end())
-				camera_trans_ptr->position -= camera_trans_ptr->left() * 0.1f;
+				camera_trans_ptr->position(camera_trans_ptr->position() - camera_trans_ptr->left() * 0.1f);
 			
 			if (keys.find(GLFW_KEY_SPACE) != keys.end())
-				camera_trans_ptr->position += camera_trans_ptr->up() * 0.1f;
+				camera_trans_ptr->position(camera_trans_ptr->position() + camera_trans_ptr->up() * 0.1f);
 			
 			if (keys.find(GLFW_KEY_LEFT_SHIFT) != keys.end())
-				camera_trans_ptr->position -= camera_trans_ptr->up() * 0.1f;
+				camera_trans_ptr->position(camera_trans_ptr->position() - camera_trans_ptr->up() * 0.1f);
 			
 			if (keys.find(GLFW_KEY_ESCAPE) != keys.end())
 				window_->Close();
@@ -228,7 +194,7 @@ namespace efiilj
 			else
 			{
 				shader_ptr->use();
-				shader_ptr->set_uniform("u_camera_position", camera_trans_ptr->position);
+				shader_ptr->set_uniform("u_camera_position", camera_trans_ptr->position());
 				shader_ptr->set_uniform("u_light.color", p_light.rgb);
 				shader_ptr->set_uniform("u_light.intensity", p_light.intensity);
 				shader_ptr->set_uniform("u_light.position", p_light.position); // should not be vec4!
@@ -0,0 +1,33 @@
+#version 430
+
+layout(location = 0) in vec4 pos;
+layout(location = 1) in vec2 normal;
+layout(location = 2) in vec4 color;
+layout(location = 3) in vec2 uv;
+
+layout(location = 0) out vec3 Fragment;
+layout(location = 1) out vec3 Normal;
+layout(location = 2) out vec4 Color;
+layout(location = 3) out vec2 Uv;
+
+uniform mat4 u_camera;
+uniform mat4 u_model;
+uniform mat4 u_decode;
+
+vec3 decode_normal(vec2 oct)
+{
+	vec3 n = vec3(oct, 1.0 - abs(oct.x) - abs(oct.y));
+	if (n.z < 0.0)
+		n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+	return normalize(n);
+}
+
+void main()
+{
+	vec4 position = u_decode * pos;
+	gl_Position = u_camera * u_model * position;
+	Uv = uv;
+	Color = color;
+	Normal = mat3(transpose(inverse(u_model))) * decode_normal(normal);
+	Fragment = (u_model * position).xyz;
+}
@@ -0,0 +1,382 @@
+//------------------------------------------------------------------------------
+// main.cc
+// (C) 2015-2018 Individual contributors, see AUTHORS file
+//------------------------------------------------------------------------------
+#include "config.h"
+#include "loader.h"
+#include "bounds.h"
+#include "swrast.h"
+#include "swshaders.h"
+#include "color.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <algorithm>
+
+/*
+ * Renders a fixed set of scenes with the software rasterizer, without opening a window or creating a GL context,
+ * and reports the frame rate along with the time spent in each stage of the pipeline, as well as the time taken to parse each mesh
+ * and to load it from the mesh cache.
+ *
+ * The frame rate is measured with profiling disabled, and the stage timings in a second pass with profiling enabled,
+ * so that reading the clock does not skew the frame rate. Results are written as JSON, and if a baseline JSON written
+ * by an earlier run is given, the frame and load times of each scene are compared against it.
+ *
+ * Fragments are shaded in floating-point by default, or with packed RGBA8 texels and fixed-point light factors if the shading is fixed.
+ * Hidden fragments are shaded as faces are filled by default, or avoided with a depth pre-pass or deferred shading.
+ * The profiled pass also reports the shading overdraw and depth complexity of each scene, as fragments per drawn pixel,
+ * and the share of tested fragments rejected by the depth test before shading. Nodes and faces are drawn in submission order
+ * by default, or sorted front to back if the order is sorted.
+ *
+ * Usage: RasterBench [frames] [mode = serial|tiled] [output] [baseline] [shading = float|fixed] [visibility = forward|prepass|deferred]
+ *        [order = submit|sorted]
+ */
+
+namespace
+{
+	using namespace efiilj;
+
+	/**
+	 * \brief A mesh rendered from a fixed camera pose at a fixed resolution.
+	 * Scenes with several copies place them in a row receding from the camera, and submit them farthest first,
+	 * so that drawing in submission order shades every copy hidden behind a nearer one.
+	 * The origin moves the whole scene along the world x axis, away from the world origin, where the draw order
+	 * only stays front to back if nodes are sorted by their world-space distance from the camera.
+	 */
+	struct bench_scene
+	{
+		const char* name;
+		const char* mesh;
+		const char* texture;
+		int size;
+		float distance;
+		float yaw;
+		int copies;
+		float spacing;
+		float origin;
+	};
+
+	/**
+	 * \brief The measured results of a single scene.
+	 */
+	struct bench_result
+	{
+		std::string name;
+		int size;
+		unsigned faces;
+		double parse_ms, load_ms, fps, frame_ms;
+		double overdraw, depth_complexity, rejected;
+		raster_timings timings;
+	};
+
+	/**
+	 * \brief How the rasterizer avoids shading fragments hidden behind nearer ones.
+	 */
+	enum bench_visibility
+	{
+		visibility_forward,
+		visibility_prepass,
+		visibility_deferred
+	};
+
+	const char* const visibility_names[] = { "forward", "prepass", "deferred" };
+
+	const bench_scene scenes[] =
+	{
+		{ "cat_512", "./res/meshes/cat.obj", "./res/textures/fox_base.png", 512, 2.5f, 0.0f, 1, 0.0f, 0.0f },
+		{ "cat_close_1024", "./res/meshes/cat.obj", "./res/textures/fox_base.png", 1024, 1.2f, 0.6f, 1, 0.0f, 0.0f },
+		{ "fox_1024", "./res/meshes/fox.obj", "./res/textures/fox_base.png", 1024, 2.5f, 0.8f, 1, 0.0f, 0.0f },
+		{ "rock_1024", "./res/meshes/rock.obj", "./res/textures/rock_base.png", 1024, 2.0f, 0.0f, 1, 0.0f, 0.0f },
+		{ "mushroom_1024", "./res/meshes/mushroom.obj", "./res/textures/colors.png", 1024, 2.5f, -0.4f, 1, 0.0f, 0.0f },
+		{ "fox_row_1024", "./res/meshes/fox.obj", "./res/textures/fox_base.png", 1024, 2.5f, 0.8f, 4, 1.0f, 20.0f }
+	};
+
+	const int warmup_frames = 3;
+	const int load_runs = 5;
+
+	/**
+	 * \brief Loads and renders a scene for a number of frames, first to measure the frame rate and then to measure stage timings.
+	 * \param scene The scene which should be rendered
+	 * \param frames The number of frames to render in each pass
+	 * \param mode Whether to render serially, or in parallel screen tiles
+	 * \param fixed Whether to shade fragments with the fixed-point shader
+	 * \param visibility Whether to use a depth pre-pass or deferred shading
+	 * \param sorted Whether to draw nodes and faces front to back
+	 * \param result The results of the scene
+	 * \return True if the mesh was loaded, false otherwise
+	 */
+	bool run_scene(const bench_scene& scene, const int frames, const raster_mode mode, const bool fixed, const bench_visibility visibility, const bool sorted,
+	               bench_result& result)
+	{
+		// Load the mesh a few times and keep the fastest, as the first load may have to wait for the disk.
+		// Parsing bypasses the mesh cache, while loading uses the cache written by the first load.
+		result.parse_ms = 0;
+		result.load_ms = 0;
+
+		for (int i = 0; i < load_runs * 2; i++)
+		{
+			const bool cached = i >= load_runs;
+			const auto load_start = std::chrono::steady_clock::now();
+			object_loader timed_loader(scene.mesh, 0, cached);
+			const double load_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - load_start).count();
+
+			double& best = cached ? result.load_ms : result.parse_ms;
+			if (i % load_runs == 0 || load_ms < best)
+				best = load_ms;
+		}
+
+		object_loader loader(scene.mesh);
+
+		if (!loader.is_valid())
+		{
+			std::cout << "Failed to load OBJ file " << scene.mesh << "\n";
+			return false;
+		}
+
+		// Fit the mesh into a unit sphere at the origin, so the camera distance is independent of mesh size
+		const bounding_box& bounds = loader.bounds();
+		const vector4 center = (bounds.lower + bounds.upper) * 0.5f;
+		const float radius = std::max(vector4::dist(bounds.lower, bounds.upper) * 0.5f, 0.0001f);
+
+		// The model matrix rotates before translating, so the center is rotated into place before being cancelled out
+		const vector3 rotation(0, scene.yaw, 0);
+		const vector4 offset = matrix4::get_rotation_xyz(rotation) * center * (-1 / radius);
+
+		auto camera_trans_ptr = std::make_shared<transform_model>(vector3(scene.origin, 0, scene.distance), vector3(0, -1.5707963f, 0), vector3(1, 1, 1));
+		auto camera_ptr = std::make_shared<camera_model>(1.3f, 1.0f, 0.1f, 100.0f, camera_trans_ptr, vector3(0, 1, 0));
+
+		auto rasterizer_ptr = std::make_shared<rasterizer>(scene.size, scene.size, camera_ptr, color(3, 0, 3, 127), mode);
+		auto tex_ptr = std::make_shared<texture_data>(scene.texture);
+
+		// Add the farthest copy first, stepping each nearer copy sideways so that it only partly hides the ones behind it
+		for (int i = scene.copies - 1; i >= 0; i--)
+		{
+			const vector3 position(scene.origin + offset.x() + i * scene.spacing * 0.5f, offset.y(), offset.z() - i * scene.spacing);
+			auto node_trans_ptr = std::make_shared<transform_model>(position, rotation, vector3(1 / radius, 1 / radius, 1 / radius));
+			std::shared_ptr<rasterizer_node> node_ptr;
+
+			if (fixed)
+				node_ptr = make_pipeline_node(loader.get_vertices(), loader.get_indices(), node_trans_ptr, phong_vertex_shader(), phong_fixed_fragment_shader());
+			else
+				node_ptr = make_pipeline_node(loader.get_vertices(), loader.get_indices(), node_trans_ptr, phong_vertex_shader(), phong_fragment_shader());
+
+			// The node takes the texture pointer it is given, so give each node its own reference
+			auto node_tex_ptr = tex_ptr;
+			node_ptr->texture(node_tex_ptr);
+			rasterizer_ptr->add_node(node_ptr);
+		}
+		rasterizer_ptr->set_depth_prepass(visibility == visibility_prepass);
+		rasterizer_ptr->set_deferred(visibility == visibility_deferred);
+		rasterizer_ptr->set_sort_nodes(sorted);
+		rasterizer_ptr->set_sort_faces(sorted);
+
+		for (int i = 0; i < warmup_frames; i++)
+			rasterizer_ptr->render();
+
+		const auto start = std::chrono::steady_clock::now();
+
+		for (int i = 0; i < frames; i++)
+			rasterizer_ptr->render();
+
+		const double total_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		rasterizer_ptr->set_profile(true);
+		raster_timings timings;
+		raster_stats stats;
+
+		for (int i = 0; i < frames; i++)
+		{
+			rasterizer_ptr->render();
+			timings += rasterizer_ptr->get_timings();
+			stats += rasterizer_ptr->get_stats();
+		}
+
+		const double scale = 1.0 / frames;
+
+		result.name = scene.name;
+		result.size = scene.size;
+		result.faces = static_cast<unsigned>(loader.index_count() / 3 * scene.copies);
+		result.frame_ms = total_ms * scale;
+		result.fps = result.frame_ms > 0 ? 1000.0 / result.frame_ms : 0;
+
+		result.timings.clear = timings.clear * scale;
+		result.timings.vertex = timings.vertex * scale;
+		result.timings.setup = timings.setup * scale;
+		result.timings.raster = timings.raster * scale;
+		result.timings.fragment = timings.fragment * scale;
+
+		// Fragments per pixel covered at the end of the frame
+		const double drawn = stats.pixels_drawn;
+		result.overdraw = drawn > 0 ? stats.fragments_shaded / drawn : 0;
+		result.depth_complexity = drawn > 0 ? stats.fragments_tested / drawn : 0;
+		result.rejected = stats.fragments_tested > 0 ? static_cast<double>(stats.fragments_occluded) / stats.fragments_tested : 0;
+
+		return true;
+	}
+
+	/**
+	 * \brief Finds a time measured for a scene in a JSON file written by an earlier run.
+	 * \param json The contents of the baseline file
+	 * \param name The name of the scene
+	 * \param field The name of the measured time, such as "frame_ms"
+	 * \param ms The time measured for the scene in the baseline
+	 * \return True if the scene and time were found, false otherwise
+	 */
+	bool find_baseline(const std::string& json, const std::string& name, const std::string& field, double& ms)
+	{
+		const size_t scene = json.find("\"name\": \"" + name + "\"");
+		if (scene == std::string::npos)
+			return false;
+
+		const std::string key = "\"" + field + "\": ";
+		const size_t value = json.find(key, scene);
+		if (value == std::string::npos || value > json.find('}', scene))
+			return false;
+
+		ms = std::strtod(json.c_str() + value + key.size(), nullptr);
+		return ms > 0;
+	}
+
+	/**
+	 * \brief Writes the results of all scenes as JSON.
+	 * \param path The path of the output file
+	 * \param mode Whether the scenes were rendered serially, or in parallel screen tiles
+	 * \param fixed Whether fragments were shaded with the fixed-point shader
+	 * \param visibility Whether a depth pre-pass or deferred shading was used
+	 * \param sorted Whether nodes and faces were drawn front to back
+	 * \param frames The number of frames rendered in each pass
+	 * \param results The results of all scenes
+	 * \return True if the file was written, false otherwise
+	 */
+	bool write_results(const std::string& path, const raster_mode mode, const bool fixed, const bench_visibility visibility, const bool sorted,
+	                   const int frames, const std::vector<bench_result>& results)
+	{
+		std::ofstream file(path);
+
+		if (!file.is_open())
+			return false;
+
+		file << std::fixed << std::setprecision(4);
+		file << "{\n";
+		file << "\t\"mode\": \"" << (mode == raster_tiled ? "tiled" : "serial") << "\",\n";
+		file << "\t\"shading\": \"" << (fixed ? "fixed" : "float") << "\",\n";
+		file << "\t\"visibility\": \"" << visibility_names[visibility] << "\",\n";
+		file << "\t\"order\": \"" << (sorted ? "sorted" : "submit") << "\",\n";
+		file << "\t\"frames\": " << frames << ",\n";
+		file << "\t\"scenes\": [\n";
+
+		for (size_t i = 0; i < results.size(); i++)
+		{
+			const bench_result& result = results[i];
+
+			file << "\t\t{ \"name\": \"" << result.name << "\""
+				<< ", \"size\": " << result.size
+				<< ", \"faces\": " << result.faces
+				<< ", \"parse_ms\": " << result.parse_ms
+				<< ", \"load_ms\": " << result.load_ms
+				<< ", \"fps\": " << result.fps
+				<< ", \"frame_ms\": " << result.frame_ms
+				<< ", \"clear_ms\": " << result.timings.clear
+				<< ", \"vertex_ms\": " << result.timings.vertex
+				<< ", \"setup_ms\": " << result.timings.setup
+				<< ", \"raster_ms\": " << result.timings.raster
+				<< ", \"fragment_ms\": " << result.timings.fragment
+				<< ", \"overdraw\": " << result.overdraw
+				<< ", \"depth_complexity\": " << result.depth_complexity
+				<< ", \"rejected\": " << result.rejected
+				<< " }" << (i + 1 < results.size() ? ",\n" : "\n");
+		}
+
+		file << "\t]\n";
+		file << "}\n";
+
+		return file.good();
+	}
+}
+
+int
+main(int argc, const char** argv)
+{
+	using namespace efiilj;
+
+	const int frames = argc > 1 ? std::max(std::atoi(argv[1]), 1) : 50;
+	const raster_mode mode = argc > 2 && std::string(argv[2]) == "tiled" ? raster_tiled : raster_serial;
+	const std::string output = argc > 3 ? argv[3] : "./bench.json";
+	const std::string baseline_path = argc > 4 ? argv[4] : "";
+	const bool fixed = argc > 5 && std::string(argv[5]) == "fixed";
+
+	bench_visibility visibility = visibility_forward;
+
+	if (argc > 6 && std::string(argv[6]) == "prepass")
+		visibility = visibility_prepass;
+	else if (argc > 6 && std::string(argv[6]) == "deferred")
+		visibility = visibility_deferred;
+
+	const bool sorted = argc > 7 && std::string(argv[7]) == "sorted";
+
+	std::string baseline;
+
+	if (!baseline_path.empty())
+	{
+		std::ifstream file(baseline_path);
+
+		if (!file.is_open())
+		{
+			std::cout << "Failed to open baseline " << baseline_path << "\n";
+			return 1;
+		}
+
+		std::stringstream contents;
+		contents << file.rdbuf();
+		baseline = contents.str();
+	}
+
+	std::cout << std::fixed << std::setprecision(2);
+	std::cout << std::left << std::setw(16) << "scene" << std::right
+		<< std::setw(9) << "parse" << std::setw(9) << "load" << std::setw(9) << "fps" << std::setw(10) << "frame" << std::setw(9) << "clear" << std::setw(9) << "vertex"
+		<< std::setw(9) << "setup" << std::setw(9) << "raster" << std::setw(10) << "fragment" << std::setw(10) << "overdraw" << std::setw(7) << "depth" << std::setw(10) << "rejected"
+		<< (baseline.empty() ? "" : "  vs baseline (frame, load)") << "\n";
+
+	std::vector<bench_result> results;
+
+	for (const auto& scene : scenes)
+	{
+		bench_result result;
+
+		if (!run_scene(scene, frames, mode, fixed, visibility, sorted, result))
+			return 1;
+
+		std::cout << std::left << std::setw(16) << result.name << std::right
+			<< std::setw(9) << result.parse_ms << std::setw(9) << result.load_ms << std::setw(9) << result.fps << std::setw(10) << result.frame_ms
+			<< std::setw(9) << result.timings.clear << std::setw(9) << result.timings.vertex
+			<< std::setw(9) << result.timings.setup << std::setw(9) << result.timings.raster
+			<< std::setw(10) << result.timings.fragment << std::setw(10) << result.overdraw << std::setw(7) << result.depth_complexity
+			<< std::setw(10) << result.rejected;
+
+		double frame_ms, load_ms;
+		if (!baseline.empty() && find_baseline(baseline, result.name, "frame_ms", frame_ms))
+			std::cout << "  " << std::showpos << (result.frame_ms / frame_ms - 1) * 100 << std::noshowpos << "%";
+
+		if (!baseline.empty() && find_baseline(baseline, result.name, "load_ms", load_ms))
+			std::cout << "  " << std::showpos << (result.load_ms / load_ms - 1) * 100 << std::noshowpos << "%";
+
+		std::cout << "\n";
+		results.push_back(result);
+	}
+
+	if (!write_results(output, mode, fixed, visibility, sorted, frames, results))
+	{
+		std::cout << "Failed to write results to " << output << "\n";
+		return 1;
+	}
+
+	std::cout << "Wrote " << output << " (" << (mode == raster_tiled ? "tiled" : "serial") << ", " << visibility_names[visibility]
+		<< (sorted ? ", sorted" : "") << ", stage times in ms/frame, overdraw and depth complexity in fragments per pixel)\n";
+	return 0;
+}
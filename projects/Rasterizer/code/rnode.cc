@@ -1,8 +1,86 @@
 #include "rnode.h"
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
 namespace efiilj
 {
 	rasterizer_node::rasterizer_node(std::vector<vertex> vertices, std::vector<unsigned> indices, std::shared_ptr<transform_model> transform)
-	: vertices_(std::move(vertices)), indices_(std::move(indices)), transform_(std::move(transform))
+	: indices_(std::move(indices)), stream_(vertices.data(), static_cast<unsigned>(vertices.size())),
+	  transform_(std::move(transform)),
+	  bounds_(vertices.data(), static_cast<unsigned>(vertices.size())), clusters_sorted_(false)
 	{ }
+
+	void rasterizer_node::sort_clusters()
+	{
+		const unsigned faces = index_count() / 3;
+		const unsigned clusters = (faces + cluster_faces - 1) / cluster_faces;
+
+		// The nearest point of each cluster along each of +x, -x, +y, -y, +z and -z
+		std::vector<float> nearest(clusters * 6, std::numeric_limits<float>::max());
+
+		for (unsigned i = 0; i < faces * 3; i++)
+		{
+			const vector4 pos = stream_.get_position(indices_[i]);
+			float* cluster = &nearest[i / 3 / cluster_faces * 6];
+
+			for (int axis = 0; axis < 3; axis++)
+			{
+				cluster[axis * 2] = std::min(cluster[axis * 2], pos.at(axis));
+				cluster[axis * 2 + 1] = std::min(cluster[axis * 2 + 1], -pos.at(axis));
+			}
+		}
+
+		for (unsigned direction = 0; direction < 6; direction++)
+		{
+			std::vector<unsigned>& order = cluster_orders_[direction];
+			order.resize(clusters);
+
+			for (unsigned i = 0; i < clusters; i++)
+				order[i] = i;
+
+			std::stable_sort(order.begin(), order.end(), [&nearest, direction](const unsigned a, const unsigned b)
+			{
+				return nearest[a * 6 + direction] < nearest[b * 6 + direction];
+			});
+		}
+	}
+
+	const std::vector<unsigned>& rasterizer_node::cluster_order(const vector4& direction)
+	{
+		if (!clusters_sorted_)
+		{
+			sort_clusters();
+			clusters_sorted_ = true;
+		}
+
+		const float x = std::abs(direction.x());
+		const float y = std::abs(direction.y());
+		const float z = std::abs(direction.z());
+		const int axis = x >= y && x >= z ? 0 : y >= z ? 1 : 2;
+
+		return cluster_orders_[axis * 2 + (direction.at(axis) < 0 ? 1 : 0)];
+	}
+
+	void rasterizer_node::shade_vertices(const unsigned first, const unsigned count, const vertex_uniforms& uniforms, vertex_data* out)
+	{
+		for (unsigned i = 0; i < count; i++)
+		{
+			vertex vert = stream_.get_vertex(first + i);
+			out[i] = vertex_shader(&vert, uniforms);
+		}
+	}
+
+	void rasterizer_node::shade_fragments(const vertex_data* fragments, const unsigned count, fragment_uniforms& uniforms, unsigned* out) const
+	{
+		const texture_data& tex = texture();
+
+		for (unsigned i = 0; i < count; i++)
+		{
+			uniforms.normal = fragments[i].normal;
+			uniforms.fragment = fragments[i].fragment;
+			out[i] = fragment_shader(fragments[i], tex, uniforms);
+		}
+	}
 }
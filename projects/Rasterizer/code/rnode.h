@@ -3,9 +3,13 @@
 #include "vertex.h"
 #include "transform.h"
 #include "swtdata.h"
+#include "bounds.h"
+#include "vstream.h"
 
 #include <vector>
+#include <memory>
 #include <functional>
+#include <type_traits>
 #include "light.h"
 
 
@@ -21,6 +25,13 @@ namespace efiilj
 		{
 			normal = model.inverse().transpose();
 		}
+
+		/**
+		 * \brief Creates vertex uniforms with a normal matrix which is already known, such as the one cached by a transform.
+		 */
+		vertex_uniforms(const matrix4& camera, const matrix4& model, const matrix4& normal)
+			: camera(camera), model(model), normal(normal)
+		{ }
 		
 		matrix4 camera;
 		matrix4 model;
@@ -57,6 +68,12 @@ namespace efiilj
 		float ambient_strength;
 		float specular_strength;
 		int shininess;
+
+		/**
+		 * \brief The change in UV coordinates between horizontally and vertically adjacent fragments, used to select texture mip levels.
+		 */
+		vector2 uv_dx;
+		vector2 uv_dy;
 	};
 	
 	/**
@@ -65,12 +82,26 @@ namespace efiilj
 	class rasterizer_node
 	{
 	private:
-		std::vector<vertex> vertices_;
 		std::vector<unsigned> indices_;
+		vertex_stream stream_;
 		std::shared_ptr<transform_model> transform_;
 		std::shared_ptr<texture_data> texture_;
+		bounding_box bounds_;
+		std::vector<unsigned> cluster_orders_[6];
+		bool clusters_sorted_;
+
+		/**
+		 * \brief Sorts the face clusters of the node front to back for a viewer looking along each of the six axis directions.
+		 */
+		void sort_clusters();
 
 	public:
+		/**
+		 * \brief The number of consecutive faces in the index buffer which are sorted as one cluster.
+		 * Faces within a cluster keep their order, so that vertex cache optimizations of the index buffer are preserved.
+		 */
+		static const unsigned cluster_faces = 16;
+
 		/**
 		 * \brief Creates a new rasterizer node instance.
 		 * \param vertices A list of vertices representing the object
@@ -78,6 +109,7 @@ namespace efiilj
 		 * \param transform The position of the object in object-space
 		 */
 		rasterizer_node(std::vector<vertex> vertices, std::vector<unsigned> indices, std::shared_ptr<transform_model> transform);
+		virtual ~rasterizer_node() = default;
 
 		/**
 		 * \brief A function pointer for holding a vertex shader.
@@ -90,15 +122,70 @@ namespace efiilj
 		 */
 		std::function<unsigned(const vertex_data & data, const texture_data&, const fragment_uniforms&)> fragment_shader; //UV, Normal, Color Texture
 
-		unsigned int vertex_count() const { return vertices_.size(); }
+		/**
+		 * \brief Runs the vertex shader for a range of vertices in the vertex buffer.
+		 * \param first The first vertex which should be shaded
+		 * \param count The number of vertices to shade
+		 * \param uniforms The vertex shader uniforms
+		 * \param out Receives the vertex shader output for each vertex in the range
+		 */
+		virtual void shade_vertices(unsigned first, unsigned count, const vertex_uniforms& uniforms, vertex_data* out);
+
+		/**
+		 * \brief Runs the fragment shader for a number of fragments.
+		 * \param fragments The interpolated fragment data
+		 * \param count The number of fragments to shade
+		 * \param uniforms The fragment shader uniforms, whose normal and fragment position are set per fragment
+		 * \param out Receives the color of each fragment
+		 */
+		virtual void shade_fragments(const vertex_data* fragments, unsigned count, fragment_uniforms& uniforms, unsigned* out) const;
+
+		unsigned int vertex_count() const { return stream_.size(); }
+
+		/**
+		 * \brief Returns the object-space bounding box of the node vertices, computed once on creation.
+		 * \return The bounding box enclosing the node
+		 */
+		const bounding_box& bounds() const { return bounds_; }
+
 		unsigned int index_count() const { return indices_.size(); }
 
 		/**
-		 * \brief Returns a pointer to a vertex in the buffer.
-		 * \param index The index-of-indices representing the vertex which should be returned
-		 * \return A pointer to a vertex in the buffer
+		 * \brief Returns the face clusters of the node ordered front to back, for the axis direction closest to a view direction.
+		 * The orders are sorted on first use, by the nearest point of each cluster along each axis direction,
+		 * so that nodes which are never drawn with face sorting do not pay for them.
+		 * \param direction The direction in which the node is viewed, in object space
+		 * \return The positions of the clusters in the index buffer, in units of cluster_faces faces
+		 */
+		const std::vector<unsigned>& cluster_order(const vector4& direction);
+
+		/**
+		 * \brief Returns the position of a vertex in the buffer.
+		 * \param index The index-of-indices representing the vertex whose position should be returned
+		 * \return The object-space position of the vertex
+		 */
+		vector4 get_position_by_index(const unsigned index) const { return stream_.get_position(indices_[index]); }
+
+		/**
+		 * \brief Returns the position in the vertex buffer of an index.
+		 * \param index The index-of-indices which should be looked up
+		 * \return The vertex buffer position referenced by the index
+		 */
+		unsigned get_index(const unsigned index) const { return indices_[index]; }
+
+		/**
+		 * \brief Returns a copy of a vertex in the buffer.
+		 * \param position The position of the vertex in the vertex buffer
+		 * \return The vertex, read from the vertex stream
+		 */
+		vertex get_vertex(const unsigned position) const { return stream_.get_vertex(position); }
+
+		/**
+		 * \brief Returns the vertex buffer stored as a structure of arrays, built once on creation.
+		 * The stream is the only copy of the vertices kept by the node.
+		 * \return The vertex stream of the node
 		 */
-		vertex* get_by_index(const unsigned index) { return &vertices_[indices_[index]]; }
+		const vertex_stream& stream() const { return stream_; }
 
 		transform_model& transform() const { return *this->transform_; }
 		void transform(std::shared_ptr<transform_model>& transform) { this->transform_ = std::move(transform); }
@@ -106,4 +193,141 @@ namespace efiilj
 		texture_data& texture() const { return *this->texture_; }
 		void texture(std::shared_ptr<texture_data>& texture) { this->texture_ = std::move(texture); }
 	};
+
+	/**
+	 * \brief Checks whether a vertex shader type can also shade a range of a vertex stream at once,
+	 * being callable as void(const vertex_stream&, unsigned first, unsigned count, const vertex_uniforms&, vertex_data* out) const.
+	 * \tparam VS Vertex shader type
+	 */
+	template <typename VS>
+	struct is_stream_shader
+	{
+	private:
+		template <typename T>
+		static auto test(int) -> decltype(std::declval<const T&>()(std::declval<const vertex_stream&>(), 0u, 0u,
+		                                  std::declval<const vertex_uniforms&>(), static_cast<vertex_data*>(nullptr)), std::true_type());
+
+		template <typename T>
+		static std::false_type test(...);
+
+	public:
+		static const bool value = decltype(test<VS>(0))::value;
+	};
+
+	/**
+	 * \brief Checks whether a fragment shader type can also shade a number of fragments at once,
+	 * being callable as void(const vertex_data*, unsigned count, const texture_data&, const fragment_uniforms&, unsigned* out) const.
+	 * \tparam FS Fragment shader type
+	 */
+	template <typename FS>
+	struct is_batch_shader
+	{
+	private:
+		template <typename T>
+		static auto test(int) -> decltype(std::declval<const T&>()(static_cast<const vertex_data*>(nullptr), 0u, std::declval<const texture_data&>(),
+		                                  std::declval<const fragment_uniforms&>(), static_cast<unsigned*>(nullptr)), std::true_type());
+
+		template <typename T>
+		static std::false_type test(...);
+
+	public:
+		static const bool value = decltype(test<FS>(0))::value;
+	};
+
+	/**
+	 * \brief A rasterizer node whose shaders are function objects known at compile time.
+	 * The shaders are called directly from the node's shading loops, so they can be inlined, unlike the std::function shaders.
+	 * If the vertex shader can shade a vertex stream, it is given whole ranges of the node's stream instead of one vertex at a time.
+	 * Likewise, a fragment shader which can shade batches is given each fragment batch in a single call,
+	 * which is how a node selects a packed fixed-point shading path such as phong_fixed_fragment_shader.
+	 * \tparam VS Vertex shader type, callable as vertex_data(vertex*, const vertex_uniforms&) const
+	 * \tparam FS Fragment shader type, callable as unsigned(const vertex_data&, const texture_data&, const fragment_uniforms&) const
+	 */
+	template <typename VS, typename FS>
+	class pipeline_node : public rasterizer_node
+	{
+	private:
+		void shade_range(const unsigned first, const unsigned count, const vertex_uniforms& uniforms, vertex_data* out, std::true_type)
+		{
+			vertex_program(stream(), first, count, uniforms, out);
+		}
+
+		void shade_range(const unsigned first, const unsigned count, const vertex_uniforms& uniforms, vertex_data* out, std::false_type)
+		{
+			for (unsigned i = 0; i < count; i++)
+			{
+				vertex vert = get_vertex(first + i);
+				out[i] = vertex_program(&vert, uniforms);
+			}
+		}
+
+		void shade_batch(const vertex_data* fragments, const unsigned count, fragment_uniforms& uniforms, unsigned* out, std::true_type) const
+		{
+			fragment_program(fragments, count, texture(), uniforms, out);
+		}
+
+		void shade_batch(const vertex_data* fragments, const unsigned count, fragment_uniforms& uniforms, unsigned* out, std::false_type) const
+		{
+			const texture_data& tex = texture();
+
+			for (unsigned i = 0; i < count; i++)
+			{
+				uniforms.normal = fragments[i].normal;
+				uniforms.fragment = fragments[i].fragment;
+				out[i] = static_cast<unsigned>(fragment_program(fragments[i], tex, uniforms));
+			}
+		}
+
+	public:
+		/**
+		 * \brief Creates a new pipeline node instance.
+		 * \param vertices A list of vertices representing the object
+		 * \param indices A list of indices for edge sharing
+		 * \param transform The position of the object in object-space
+		 * \param vs The vertex shader
+		 * \param fs The fragment shader
+		 */
+		pipeline_node(std::vector<vertex> vertices, std::vector<unsigned> indices, std::shared_ptr<transform_model> transform, VS vs, FS fs)
+			: rasterizer_node(std::move(vertices), std::move(indices), std::move(transform)), vertex_program(std::move(vs)), fragment_program(std::move(fs))
+		{
+			// Keep the std::function shaders callable, although the rasterizer never uses them for this node
+			vertex_shader = [this](vertex* vert, const vertex_uniforms& uniforms) { return vertex_program(vert, uniforms); };
+			fragment_shader = [this](const vertex_data& data, const texture_data& texture, const fragment_uniforms& uniforms)
+			{
+				return static_cast<unsigned>(fragment_program(data, texture, uniforms));
+			};
+		}
+
+		pipeline_node(const pipeline_node&) = delete;
+		pipeline_node& operator = (const pipeline_node&) = delete;
+
+		VS vertex_program;
+		FS fragment_program;
+
+		void shade_vertices(const unsigned first, const unsigned count, const vertex_uniforms& uniforms, vertex_data* out) override
+		{
+			shade_range(first, count, uniforms, out, std::integral_constant<bool, is_stream_shader<VS>::value>());
+		}
+
+		void shade_fragments(const vertex_data* fragments, const unsigned count, fragment_uniforms& uniforms, unsigned* out) const override
+		{
+			shade_batch(fragments, count, uniforms, out, std::integral_constant<bool, is_batch_shader<FS>::value>());
+		}
+	};
+
+	/**
+	 * \brief Creates a new pipeline node instance, deducing the shader types (e.g. of lambdas).
+	 * \param vertices A list of vertices representing the object
+	 * \param indices A list of indices for edge sharing
+	 * \param transform The position of the object in object-space
+	 * \param vs The vertex shader
+	 * \param fs The fragment shader
+	 * \return A shared pointer to the new node
+	 */
+	template <typename VS, typename FS>
+	std::shared_ptr<pipeline_node<VS, FS>> make_pipeline_node(std::vector<vertex> vertices, std::vector<unsigned> indices,
+	                                                          std::shared_ptr<transform_model> transform, VS vs, FS fs)
+	{
+		return std::make_shared<pipeline_node<VS, FS>>(std::move(vertices), std::move(indices), std::move(transform), std::move(vs), std::move(fs));
+	}
 }
@@ -0,0 +1,157 @@
+#include "swfixed.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SWFIXED_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace efiilj
+{
+	namespace
+	{
+		/**
+		 * \brief The largest factor, which keeps the product of a channel and a factor within a signed 16-bit lane.
+		 */
+		const int32_t max_factor = 32767;
+
+		/**
+		 * \brief Converts a float to fixed point with a number of fractional bits, rounding to nearest.
+		 */
+		int32_t to_fixed(const float value, const int bits)
+		{
+			return static_cast<int32_t>(std::floor(value * static_cast<float>(1 << bits) + 0.5f));
+		}
+
+		/**
+		 * \brief The components of a unit vector in 1.14 fixed point.
+		 */
+		struct fixed_unit
+		{
+			int32_t x, y, z;
+
+			explicit fixed_unit(const vector4& v)
+			{
+				const float length_sq = v.x() * v.x() + v.y() * v.y() + v.z() * v.z();
+
+				// A zero (or NaN) vector has no direction, so its terms drop out instead of converting an invalid scale to integer
+				if (!(length_sq > 0.0f))
+				{
+					x = y = z = 0;
+					return;
+				}
+
+				const float scale = static_cast<float>(1 << fixed_phong::unit_bits) / std::sqrt(length_sq);
+				x = static_cast<int32_t>(v.x() * scale);
+				y = static_cast<int32_t>(v.y() * scale);
+				z = static_cast<int32_t>(v.z() * scale);
+			}
+
+			int32_t dot(const fixed_unit& other) const
+			{
+				return (x * other.x + y * other.y + z * other.z) >> fixed_phong::unit_bits;
+			}
+		};
+
+		/**
+		 * \brief Modulates a single texel, matching the rounding of the SIMD path.
+		 */
+		unsigned modulate_texel(const unsigned texel, const fixed_light& light)
+		{
+			unsigned result = 0;
+
+			for (int i = 0; i < 4; i++)
+			{
+				const unsigned channel = (texel >> (i * 8)) & 0xFF;
+				const unsigned product = ((channel << 8) * light.rgba[i]) >> 16;
+				result |= std::min(product, 255u) << (i * 8);
+			}
+
+			return result;
+		}
+	}
+
+	fixed_phong::fixed_phong(const vector4& ambient, const vector4& light, const float specular_strength, const int shininess)
+		: ambient_color(ambient), light_color(light), specular_strength(specular_strength), shininess(shininess)
+	{
+		for (int i = 0; i < 4; i++)
+		{
+			ambient_[i] = to_fixed(ambient.at(i), 8);
+			light_[i] = to_fixed(light.at(i), 8);
+		}
+
+		const int steps = 1 << specular_bits;
+
+		for (int i = 0; i <= steps; i++)
+			specular_[i] = to_fixed(specular_strength * std::pow(static_cast<float>(i) / steps, shininess), unit_bits);
+	}
+
+	const fixed_phong& fixed_phong::cached(const vector4& ambient, const vector4& light, const float specular_strength, const int shininess)
+	{
+		static thread_local fixed_phong phong(ambient, light, specular_strength, shininess);
+
+		const bool changed = phong.shininess != shininess || phong.specular_strength != specular_strength ||
+			phong.ambient_color != ambient || phong.light_color != light;
+
+		if (changed)
+			phong = fixed_phong(ambient, light, specular_strength, shininess);
+
+		return phong;
+	}
+
+	fixed_light fixed_phong::shade(const vector4& normal, const vector4& fragment, const vector4& light_position, const vector4& camera_position) const
+	{
+		const fixed_unit norm(normal);
+		const fixed_unit light_dir(light_position - fragment);
+		const fixed_unit view_dir(camera_position - fragment);
+
+		const int32_t one = 1 << unit_bits;
+		const int32_t normal_light = norm.dot(light_dir);
+		const int32_t diffuse = std::max(normal_light, 0);
+
+		// The view direction dotted with the light direction reflected about the normal, 2(N.L)(N.V) - L.V
+		const int32_t view_reflect = ((2 * normal_light * norm.dot(view_dir)) >> unit_bits) - light_dir.dot(view_dir);
+		const int32_t step = std::min(std::max(view_reflect, 0), one) >> (unit_bits - specular_bits);
+		const int32_t term = diffuse + specular_[step];
+
+		fixed_light result;
+
+		for (int i = 0; i < 4; i++)
+		{
+			const int32_t factor = ambient_[i] + ((light_[i] * term) >> unit_bits);
+			result.rgba[i] = static_cast<uint16_t>(std::min(std::max(factor, 0), max_factor));
+		}
+
+		return result;
+	}
+
+	void modulate_texels(const unsigned* texels, const fixed_light* light, const unsigned count, unsigned* out)
+	{
+		unsigned i = 0;
+
+#ifdef SWFIXED_SSE2
+		const __m128i zero = _mm_setzero_si128();
+
+		for (; i + 4 <= count; i += 4)
+		{
+			const __m128i packed = _mm_loadu_si128(reinterpret_cast<const __m128i*>(texels + i));
+
+			// Widen each channel to the high byte of a 16-bit lane, so that the high half of the product is (channel * factor) >> 8
+			const __m128i low = _mm_unpacklo_epi8(zero, packed);
+			const __m128i high = _mm_unpackhi_epi8(zero, packed);
+
+			const __m128i light_low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(light + i));
+			const __m128i light_high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(light + i + 2));
+
+			// Products stay below 32768, so packing with signed saturation clamps them to 255
+			const __m128i result = _mm_packus_epi16(_mm_mulhi_epu16(low, light_low), _mm_mulhi_epu16(high, light_high));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), result);
+		}
+#endif
+
+		for (; i < count; i++)
+			out[i] = modulate_texel(texels[i], light[i]);
+	}
+}
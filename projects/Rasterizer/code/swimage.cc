@@ -0,0 +1,81 @@
+#include "swimage.h"
+
+#include <vector>
+#include <fstream>
+#include <algorithm>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+namespace efiilj
+{
+	bool image_writer::write_pixels(const std::string& path, const unsigned char* pixels, const int width, const int height, const int components)
+	{
+		const size_t stride = static_cast<size_t>(width) * components;
+
+		// Flip the rows, as the raster origin is in the bottom-left corner
+		std::vector<unsigned char> flipped(stride * height);
+		for (int y = 0; y < height; y++)
+			std::copy(pixels + stride * y, pixels + stride * (y + 1), flipped.begin() + stride * (height - 1 - y));
+
+		const size_t dot = path.find_last_of('.');
+		std::string extension = dot == std::string::npos ? "" : path.substr(dot + 1);
+		std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+
+		if (extension == "png")
+			return stbi_write_png(path.c_str(), width, height, components, flipped.data(), static_cast<int>(stride)) != 0;
+
+		std::ofstream file(path, std::ios::binary);
+		if (!file)
+			return false;
+
+		file << (components == 1 ? "P5" : "P6") << "\n" << width << " " << height << "\n255\n";
+		file.write(reinterpret_cast<const char*>(flipped.data()), flipped.size());
+
+		return file.good();
+	}
+
+	bool image_writer::write_color(const std::string& path, const unsigned* buffer, const int width, const int height)
+	{
+		const size_t count = static_cast<size_t>(width) * height;
+		const auto* rgba = reinterpret_cast<const unsigned char*>(buffer);
+		std::vector<unsigned char> rgb(count * 3);
+
+		for (size_t i = 0; i < count; i++)
+		{
+			rgb[i * 3] = rgba[i * 4];
+			rgb[i * 3 + 1] = rgba[i * 4 + 1];
+			rgb[i * 3 + 2] = rgba[i * 4 + 2];
+		}
+
+		return write_pixels(path, rgb.data(), width, height, 3);
+	}
+
+	bool image_writer::write_depth(const std::string& path, const float* buffer, const int width, const int height)
+	{
+		const size_t count = static_cast<size_t>(width) * height;
+
+		// Find the range of depth values which have been written since the buffer was cleared
+		float closest = 1, farthest = 0;
+		for (size_t i = 0; i < count; i++)
+		{
+			if (buffer[i] < 1)
+			{
+				closest = std::min(closest, buffer[i]);
+				farthest = std::max(farthest, buffer[i]);
+			}
+		}
+
+		const float scale = farthest > closest ? 254.0f / (farthest - closest) : 0.0f;
+		std::vector<unsigned char> gray(count);
+
+		for (size_t i = 0; i < count; i++)
+		{
+			gray[i] = buffer[i] < 1
+				? static_cast<unsigned char>((std::max(buffer[i], closest) - closest) * scale)
+				: 255;
+		}
+
+		return write_pixels(path, gray.data(), width, height, 1);
+	}
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <string>
+
+namespace efiilj
+{
+	/**
+	 * \brief Writes raster buffers to image files, without needing a graphics context.
+	 * The format is selected by file extension: ".png" writes a PNG, anything else a binary PPM (color) or PGM (depth).
+	 * Rows are flipped so that the images appear as they do on screen.
+	 */
+	class image_writer
+	{
+	private:
+
+		/**
+		 * \brief Writes tightly packed 8-bit pixels, with the first row at the bottom of the image.
+		 * \param path The file which should be written
+		 * \param pixels Pixel data, with one byte per component
+		 * \param width Width of the image in pixels
+		 * \param height Height of the image in pixels
+		 * \param components Number of components per pixel (1 = gray, 3 = RGB)
+		 * \return True if the file was written, false otherwise
+		 */
+		static bool write_pixels(const std::string& path, const unsigned char* pixels, int width, int height, int components);
+
+	public:
+
+		/**
+		 * \brief Writes a color buffer (e.g. rasterizer::get_frame_buffer()) to an RGB image, ignoring alpha.
+		 * \param path The file which should be written
+		 * \param buffer The color buffer, in packed RGBA8
+		 * \param width Width of the buffer in pixels
+		 * \param height Height of the buffer in pixels
+		 * \return True if the file was written, false otherwise
+		 */
+		static bool write_color(const std::string& path, const unsigned* buffer, int width, int height);
+
+		/**
+		 * \brief Writes a depth buffer (e.g. rasterizer::get_depth_buffer()) to a grayscale image.
+		 * Depth is normalized over the range of written values, from black (near) to white, and cleared pixels are white.
+		 * \param path The file which should be written
+		 * \param buffer The depth buffer
+		 * \param width Width of the buffer in pixels
+		 * \param height Height of the buffer in pixels
+		 * \return True if the file was written, false otherwise
+		 */
+		static bool write_depth(const std::string& path, const float* buffer, int width, int height);
+	};
+}
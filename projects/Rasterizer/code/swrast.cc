@@ -3,18 +3,59 @@
 
 #include <algorithm>
 #include <utility>
+#include <cmath>
+#include <cstdint>
 
 namespace efiilj
 {
 	rasterizer::rasterizer(const int height, const int width,
-	                       std::shared_ptr<camera_model> camera, const unsigned int color)
-		: height_(height), width_(width), color_(color), camera_(std::move(camera))
+	                       std::shared_ptr<camera_model> camera, const unsigned int color,
+	                       const raster_mode mode, const unsigned threads)
+		: height_(height), width_(width), color_(color), mode_(mode), traversal_(traversal_scanline),
+		  simd_max_width_(cpu_has_avx2() ? 8 : 4), simd_width_(simd_max_width_), hiz_(true), profile_(false),
+		  deferred_(false), prepass_(false), threads_(threads), sort_nodes_(false), sort_faces_(false),
+		  camera_(std::move(camera))
 	{
 		buffer_ = new unsigned int[width * height];
 		depth_ = new float[width * height];
 		x_offset_ = static_cast<float>(width_) / 2;
 		y_offset_ = static_cast<float>(height_) / 2;
 
+		// Coarse depth is kept per 8x8 block, which never straddles a tile as the tile size is a multiple of 8
+		blocks_x_ = (width_ + (1 << block_bits_) - 1) >> block_bits_;
+		blocks_y_ = (height_ + (1 << block_bits_) - 1) >> block_bits_;
+		block_depth_.resize(blocks_x_ * blocks_y_);
+		block_dirty_.resize(blocks_x_ * blocks_y_);
+
+		screen_.x1 = 0;
+		screen_.y1 = 0;
+		screen_.x2 = width_;
+		screen_.y2 = height_;
+
+		// Split the raster into tiles, with partial tiles along the right and bottom edges
+		tiles_x_ = (width_ + tile_size_ - 1) / tile_size_;
+		tiles_y_ = (height_ + tile_size_ - 1) / tile_size_;
+
+		if (mode_ == raster_tiled)
+		{
+			// Create the tiles in place rather than copying them in, as each holds a large fragment batch
+			tiles_.resize(static_cast<size_t>(tiles_x_) * tiles_y_);
+
+			for (int ty = 0; ty < tiles_y_; ty++)
+			{
+				for (int tx = 0; tx < tiles_x_; tx++)
+				{
+					tile_data& tile = tiles_[tx + tiles_x_ * ty];
+					tile.x1 = tx * tile_size_;
+					tile.y1 = ty * tile_size_;
+					tile.x2 = std::min(tile.x1 + tile_size_, width_);
+					tile.y2 = std::min(tile.y1 + tile_size_, height_);
+				}
+			}
+
+			workers_.reset(new worker_pool(threads));
+		}
+
 		clear();
 	}
 
@@ -44,18 +85,144 @@ namespace efiilj
 		return vector4::dot(cam_to_tri, face_normal) >= 0;
 	}
 
-	bool rasterizer::depth_test(const int x, const int y, const float z) const
+	unsigned short rasterizer::get_clip_code(const vector4& pos) const
+	{
+		const float w = pos.w();
+		const float guard = guard_band_ * w;
+		unsigned short code = 0;
+
+		// The camera projection maps the near plane to z = 0 and the far plane to z = w
+		if (pos.z() < 0) code |= clip_near;
+		if (pos.z() > w) code |= clip_far;
+		if (pos.x() < -w) code |= clip_left;
+		if (pos.x() > w) code |= clip_right;
+		if (pos.y() < -w) code |= clip_bottom;
+		if (pos.y() > w) code |= clip_top;
+		if (pos.x() < -guard) code |= clip_guard_left;
+		if (pos.x() > guard) code |= clip_guard_right;
+		if (pos.y() < -guard) code |= clip_guard_bottom;
+		if (pos.y() > guard) code |= clip_guard_top;
+
+		return code;
+	}
+
+	bool rasterizer::is_visible(rasterizer_node& node) const
+	{
+		return view_frustum(camera_->view_perspective() * node.transform().model()).intersects(node.bounds());
+	}
+
+	vertex_data rasterizer::lerp_vertex(const vertex_data& a, const vertex_data& b, const float t)
+	{
+		// Interpolate per component, as vector4 subtraction does not preserve w
+		const auto lerp = [t](const vector4& u, const vector4& v)
+		{
+			return vector4(
+				u.x() + (v.x() - u.x()) * t,
+				u.y() + (v.y() - u.y()) * t,
+				u.z() + (v.z() - u.z()) * t,
+				u.w() + (v.w() - u.w()) * t);
+		};
+
+		return vertex_data
+		{
+			lerp(a.pos, b.pos),
+			lerp(a.fragment, b.fragment),
+			lerp(a.normal, b.normal),
+			lerp(a.color, b.color),
+			a.uv + (b.uv - a.uv) * t
+		};
+	}
+
+	bool rasterizer::depth_test(const int x, const int y, const float z)
 	{
 		float* mem = &depth_[x + width_ * y];
 
 		if (z < *mem)
 		{
 			*mem = z;
+			block_dirty_[(x >> block_bits_) + blocks_x_ * (y >> block_bits_)] = 1;
 			return true;
 		}
 		return false;
 	}
 
+	float rasterizer::block_depth(const int bx, const int by)
+	{
+		const int index = bx + blocks_x_ * by;
+
+		if (block_dirty_[index])
+		{
+			const int x1 = bx << block_bits_;
+			const int y1 = by << block_bits_;
+			const int x2 = std::min(x1 + (1 << block_bits_), width_);
+			const int y2 = std::min(y1 + (1 << block_bits_), height_);
+
+			float max = depth_[x1 + width_ * y1];
+			for (int y = y1; y < y2; y++)
+			{
+				const float* row = depth_ + width_ * y;
+				for (int x = x1; x < x2; x++)
+					max = std::max(max, row[x]);
+			}
+
+			block_depth_[index] = max;
+			block_dirty_[index] = 0;
+		}
+
+		return block_depth_[index];
+	}
+
+	bool rasterizer::face_occluded(const face_data& face, const tile_data& tile)
+	{
+		const vertex_data* data = face.data;
+		const float z_min = std::min(std::min(data[0].pos.z(), data[1].pos.z()), data[2].pos.z());
+		const float z_abs = std::max(std::max(std::abs(data[0].pos.z()), std::abs(data[1].pos.z())), std::abs(data[2].pos.z()));
+
+		// Leave some room for rounding in the interpolated depth, and never reject faces with non-finite depth
+		const float bound = z_min - hiz_epsilon_ * (1 + z_abs);
+		if (!std::isfinite(bound))
+			return false;
+
+		const int x1 = std::max(face.min_x, tile.x1);
+		const int y1 = std::max(face.min_y, tile.y1);
+		const int x2 = std::min(face.max_x, tile.x2 - 1);
+		const int y2 = std::min(face.max_y, tile.y2 - 1);
+
+		if (x1 > x2 || y1 > y2)
+			return false;
+
+		// The face is hidden if its nearest point is behind the farthest depth of every block it may touch
+		for (int by = y1 >> block_bits_; by <= y2 >> block_bits_; by++)
+		{
+			for (int bx = x1 >> block_bits_; bx <= x2 >> block_bits_; bx++)
+			{
+				if (bound < block_depth(bx, by))
+					return false;
+			}
+		}
+
+		return true;
+	}
+
+	// ReSharper disable once CppMemberFunctionMayBeConst
+	void rasterizer::clear(const tile_data& tile)
+	{
+		for (int y = tile.y1; y < tile.y2; y++)
+		{
+			std::fill(buffer_ + tile.x1 + width_ * y, buffer_ + tile.x2 + width_ * y, color_);
+			std::fill(depth_ + tile.x1 + width_ * y, depth_ + tile.x2 + width_ * y, 1);
+		}
+
+		for (int by = tile.y1 >> block_bits_; by << block_bits_ < tile.y2; by++)
+		{
+			for (int bx = tile.x1 >> block_bits_; bx << block_bits_ < tile.x2; bx++)
+			{
+				block_depth_[bx + blocks_x_ * by] = 1;
+				block_dirty_[bx + blocks_x_ * by] = 0;
+			}
+		}
+	}
+
 	// ReSharper disable once CppMemberFunctionMayBeConst
 	void rasterizer::put_pixel(const int x, const int y, const unsigned int c)
 	{
@@ -63,20 +230,37 @@ namespace efiilj
 			buffer_[x + width_ * y] = c;
 	}
 
-	void rasterizer::fill_scanline(const point_data& start, const point_data& end, const vector4& face_normal, const rasterizer_node& node,
-	                           vertex_data* data)
+	void rasterizer::fill_scanline(const point_data& start, const point_data& end, const vector4& face_normal, const vertex_data* data,
+	                               tile_data& tile)
 	{
 		// Calculate which point is the furthest in each X direction
 		// Draw line from left to right
-		// Cut pixels outside screen bounds
+		// Cut pixels outside screen and tile bounds
 		const int y = start.y;
-		const int x1 = std::max(std::min(start.x, end.x) - 1, 0);
-		const int x2 = std::min(std::max(start.x, end.x) + 1, width_ - 1);
+		const int x1 = std::max(std::max(std::min(start.x, end.x) - 1, 0), tile.x1);
+		const int x2 = std::min(std::min(std::max(start.x, end.x) + 1, width_ - 1), tile.x2);
 
-		// Return early if outside the raster
-		if (y < 0 || y > height_)
+		// Return early if outside the raster or tile
+		if (y < 0 || y >= height_ || y < tile.y1 || y >= tile.y2)
 			return;
 
+		switch (simd_width_)
+		{
+		case 8:
+			fill_span_avx2(y, x1, x2, face_normal, data, tile.batch);
+			break;
+		case 4:
+			fill_span_sse(y, x1, x2, face_normal, data, tile.batch);
+			break;
+		default:
+			fill_span(y, x1, x2, face_normal, data, tile.batch);
+			break;
+		}
+	}
+
+	void rasterizer::fill_span(const int y, const int x1, const int x2, const vector4& face_normal, const vertex_data* data,
+	                           fragment_batch& batch)
+	{
 		for (int x = x1; x < x2; x++)
 		{
 			// Calculate the barycentric weights of the pixel
@@ -86,71 +270,497 @@ namespace efiilj
 			if (bc.x() < 0 || bc.y() < 0 || bc.z() < 0)
 				continue;
 
-			// Interpolate the fragment data using barycentric coordinates
-			vertex_data fragment = interpolate_fragment(bc, data);
+			shade_fragment(x, y, bc, data, batch);
+		}
+	}
 
-			// Exit early if the pixel fails depth testing
-			if (!depth_test(x, y, fragment.pos.z()))
-				continue;
+	void rasterizer::shade_fragment(const int x, const int y, const vector3& bc, const vertex_data* data, fragment_batch& batch)
+	{
+		if (batch.pass == pass_visible)
+		{
+			if (take_visible(x, y, batch.face))
+				write_fragment(x, y, interpolate_fragment(bc, data), batch);
 
-			// TODO: Remove hard-coded fragment uniforms
-			fragment_uniforms uniform
-			{
-				fragment.normal,
-				fragment.fragment,
-				camera_->transform().position,
-				vector4(0.5f, 0.5f, 0.5f, 1),
-				vector4(1, 1, 1, 1),
-				vector4(2, 2, 2, 1),
-				vector4(0.025f, 0, 0.025f, 1),
-				1.0f,
-				0.5f,
-				8
-			};
+			return;
+		}
+
+		batch.tested++;
+
+		if (batch.pass == pass_depth)
+		{
+			if (depth_test(x, y, interpolate_depth(bc, data)))
+				visibility_[x + width_ * y] = batch.face;
+			else
+				batch.occluded++;
+
+			return;
+		}
 
-			// Run fragment shader for pixel and put the resulting color in the raster
-			const unsigned c = node.fragment_shader(fragment, node.texture(), uniform);
+		// Interpolate the fragment data using barycentric coordinates
+		vertex_data fragment = interpolate_fragment(bc, data);
 
-			put_pixel(x, y, c);
+		// Exit early if the pixel fails depth testing
+		if (!depth_test(x, y, fragment.pos.z()))
+		{
+			batch.occluded++;
+			return;
 		}
+
+		write_fragment(x, y, fragment, batch);
 	}
 
-	void rasterizer::draw_tri(rasterizer_node& node, const matrix4& local, const unsigned index)
+	void rasterizer::flush_fragments(fragment_batch& batch)
 	{
-		// Get model face vertices
-		vertex* vertices[] =
+		if (batch.count == 0)
+			return;
+
+		// TODO: Remove hard-coded fragment uniforms
+		fragment_uniforms uniform
 		{
-			node.get_by_index(index),
-			node.get_by_index(index + 1),
-			node.get_by_index(index + 2)
+			vector4(),
+			vector4(),
+			camera_->transform().position(),
+			vector4(0.5f, 0.5f, 0.5f, 1),
+			vector4(1, 1, 1, 1),
+			vector4(2, 2, 2, 1),
+			vector4(0.025f, 0, 0.025f, 1),
+			1.0f,
+			0.5f,
+			8,
+			batch.uv_dx,
+			batch.uv_dy
 		};
 
-		const vector4 face_normal = get_face_normal(vertices[0]->xyzw, vertices[1]->xyzw, vertices[2]->xyzw);
-		const vector4 camera_local = local * camera_->transform().position;
+		const auto start = profile_start();
 
-		// Exit early if normal is facing away from camera
-		if (cull_backface(vertices[0]->xyzw, face_normal, camera_local))
+		// Run fragment shader for the batch and put the resulting colors in the raster
+		batch.node->shade_fragments(batch.data, batch.count, uniform, batch.color);
+		batch.shaded += batch.count;
+
+		for (unsigned i = 0; i < batch.count; i++)
+			put_pixel(batch.x[i], batch.y[i], batch.color[i]);
+
+		if (profile_)
+			batch.shade_time += elapsed_ms(start);
+
+		batch.count = 0;
+	}
+
+	void rasterizer::fill_halfspace(const face_data& face, tile_data& tile)
+	{
+		const vertex_data* data = face.data;
+		const float steps = static_cast<float>(1 << subpixel_bits_);
+		const int64_t half = 1 << (subpixel_bits_ - 1);
+
+		// Skip faces too far outside the raster to be snapped without overflow (or with NaN positions)
+		for (int i = 0; i < 3; i++)
+		{
+			if (!(std::abs(data[i].pos.x()) < halfspace_guard_ && std::abs(data[i].pos.y()) < halfspace_guard_))
+				return;
+		}
+
+		// Snap vertex positions to fixed point with sub-pixel precision
+		int64_t vx[3], vy[3];
+		for (int i = 0; i < 3; i++)
+		{
+			vx[i] = static_cast<int64_t>(std::round(data[i].pos.x() * steps));
+			vy[i] = static_cast<int64_t>(std::round(data[i].pos.y() * steps));
+		}
+
+		// Orient the face so that its interior has positive edge functions
+		int order[] = { 0, 1, 2 };
+		int64_t area = (vx[1] - vx[0]) * (vy[2] - vy[0]) - (vy[1] - vy[0]) * (vx[2] - vx[0]);
+
+		if (area == 0)
+			return;
+
+		if (area < 0)
+		{
+			std::swap(order[1], order[2]);
+			area = -area;
+		}
+
+		// Find the pixel bounds of the face, clipped to the tile
+		const int64_t min_fx = std::min(std::min(vx[0], vx[1]), vx[2]);
+		const int64_t max_fx = std::max(std::max(vx[0], vx[1]), vx[2]);
+		const int64_t min_fy = std::min(std::min(vy[0], vy[1]), vy[2]);
+		const int64_t max_fy = std::max(std::max(vy[0], vy[1]), vy[2]);
+
+		const int x1 = static_cast<int>(std::max<int64_t>(min_fx >> subpixel_bits_, tile.x1));
+		const int x2 = static_cast<int>(std::min<int64_t>((max_fx >> subpixel_bits_) + 1, tile.x2));
+		const int y1 = static_cast<int>(std::max<int64_t>(min_fy >> subpixel_bits_, tile.y1));
+		const int y2 = static_cast<int>(std::min<int64_t>((max_fy >> subpixel_bits_) + 1, tile.y2));
+
+		if (x1 >= x2 || y1 >= y2)
 			return;
 
-		// Create uniforms struct using camera view/perspective and node model transform
-		const vertex_uniforms vertex_u(camera_->view_perspective(), node.transform().model());
+		// Set up the edge opposite each vertex, evaluated at the first pixel center
+		const int64_t px = (static_cast<int64_t>(x1) << subpixel_bits_) + half;
+		const int64_t py = (static_cast<int64_t>(y1) << subpixel_bits_) + half;
+		const float inv_area = 1.0f / static_cast<float>(area);
+
+		int64_t row[3], step_x[3], step_y[3], bias[3];
+
+		for (int i = 0; i < 3; i++)
+		{
+			const int a = order[(i + 1) % 3];
+			const int b = order[(i + 2) % 3];
+			const int64_t dx = vx[b] - vx[a];
+			const int64_t dy = vy[b] - vy[a];
+			const int k = order[i];
+
+			// Top-left fill rule: pixels exactly on an edge belong only to left edges and flat top edges
+			bias[k] = dy < 0 || (dy == 0 && dx < 0) ? 0 : -1;
+
+			row[k] = dx * (py - vy[a]) - dy * (px - vx[a]) + bias[k];
+			step_x[k] = -dy * (1 << subpixel_bits_);
+			step_y[k] = dx * (1 << subpixel_bits_);
+		}
+
+		const float z[] = { data[0].pos.z(), data[1].pos.z(), data[2].pos.z() };
+		const float z_min = std::min(std::min(z[0], z[1]), z[2]);
+		const float z_eps = hiz_epsilon_ * (1 + std::max(std::max(std::abs(z[0]), std::abs(z[1])), std::abs(z[2])));
+
+		// Walk the bounds in 8x8 blocks aligned to the raster, so that each can be rejected as a whole
+		for (int by = y1 >> block_bits_; by << block_bits_ < y2; by++)
+		{
+			const int block_y1 = std::max(by << block_bits_, y1);
+			const int block_y2 = std::min((by + 1) << block_bits_, y2);
+
+			for (int bx = x1 >> block_bits_; bx << block_bits_ < x2; bx++)
+			{
+				const int block_x1 = std::max(bx << block_bits_, x1);
+				const int block_x2 = std::min((bx + 1) << block_bits_, x2);
+
+				// Edge functions at the corner pixels of the block
+				int64_t corner[3][4];
+				bool outside = false;
+
+				for (int i = 0; i < 3; i++)
+				{
+					const int64_t origin = row[i] + step_x[i] * (block_x1 - x1) + step_y[i] * (block_y1 - y1);
+					const int64_t right = step_x[i] * (block_x2 - block_x1 - 1);
+					const int64_t down = step_y[i] * (block_y2 - block_y1 - 1);
+
+					corner[i][0] = origin;
+					corner[i][1] = origin + right;
+					corner[i][2] = origin + down;
+					corner[i][3] = origin + right + down;
+
+					// The block is empty if all of its corners are outside the same edge
+					outside |= (corner[i][0] & corner[i][1] & corner[i][2] & corner[i][3]) < 0;
+				}
+
+				if (outside)
+					continue;
+
+				if (hiz_)
+				{
+					// Depth is planar over the face, so its nearest point within the block is at a corner
+					float block_min = z_min;
+					for (int c = 0; c < 4; c++)
+					{
+						const float corner_z =
+							z[0] * (static_cast<float>(corner[0][c] - bias[0]) * inv_area) +
+							z[1] * (static_cast<float>(corner[1][c] - bias[1]) * inv_area) +
+							z[2] * (static_cast<float>(corner[2][c] - bias[2]) * inv_area);
+
+						block_min = std::min(block_min, corner_z);
+					}
+
+					block_min = std::max(block_min, z_min) - z_eps;
+
+					if (block_min >= block_depth(bx, by))
+					{
+						// The shading pass of the depth pre-pass rejects the same blocks again
+						if (tile.batch.pass != pass_visible)
+							tile.stats.blocks_occluded++;
+
+						continue;
+					}
+				}
+
+				int64_t w_row[] = { corner[0][0], corner[1][0], corner[2][0] };
+
+				for (int y = block_y1; y < block_y2; y++)
+				{
+					int64_t w0 = w_row[0], w1 = w_row[1], w2 = w_row[2];
+
+					for (int x = block_x1; x < block_x2; x++)
+					{
+						// The pixel is inside if no edge function is negative
+						if ((w0 | w1 | w2) >= 0)
+						{
+							// Normalize the exact edge functions, so the weights don't depend on where stepping started (e.g. tile edges)
+							const vector3 bc(
+								static_cast<float>(w0 - bias[0]) * inv_area,
+								static_cast<float>(w1 - bias[1]) * inv_area,
+								static_cast<float>(w2 - bias[2]) * inv_area);
+
+							shade_fragment(x, y, bc, data, tile.batch);
+						}
+
+						w0 += step_x[0];
+						w1 += step_x[1];
+						w2 += step_x[2];
+					}
+
+					w_row[0] += step_y[0];
+					w_row[1] += step_y[1];
+					w_row[2] += step_y[2];
+				}
+			}
+		}
+	}
+
+	void rasterizer::transform_vertices(rasterizer_node& node)
+	{
+		// Create uniforms struct using camera view/perspective and node model transform, once for the whole node.
+		// The normal matrix is cached by the transform when the model matrix is computed.
+		const matrix4& model = node.transform().model();
+		const vertex_uniforms vertex_u(camera_->view_perspective(), model, node.transform().normal());
+		const unsigned count = node.vertex_count();
+
+		clip_cache_.resize(count);
+		vertex_cache_.resize(count);
+		clip_codes_.resize(count);
 
-		// Get vertex data from node vertex shader
-		vertex_data data[] =
+		const auto shade = [&](const unsigned first, const unsigned end)
 		{
-			node.vertex_shader(vertices[0], vertex_u),
-			node.vertex_shader(vertices[1], vertex_u),
-			node.vertex_shader(vertices[2], vertex_u)
+			// Get vertex data from node vertex shader
+			node.shade_vertices(first, end - first, vertex_u, clip_cache_.data() + first);
+
+			// Classify against the clip planes, and convert to screen-space coordinates (only used for faces which need no clipping)
+			for (unsigned i = first; i < end; i++)
+			{
+				clip_codes_[i] = get_clip_code(clip_cache_[i].pos);
+				vertex_cache_[i] = clip_cache_[i];
+				convert_screenspace(vertex_cache_[i]);
+			}
 		};
 
-		// Convert vertex data to screen-space coordinates (?)
-		convert_screenspace(data[0]);
-		convert_screenspace(data[1]);
-		convert_screenspace(data[2]);
+		if (mode_ == raster_tiled)
+		{
+			workers_->run((count + vertex_chunk_ - 1) / vertex_chunk_, [&](const unsigned chunk)
+			{
+				shade(chunk * vertex_chunk_, std::min(count, (chunk + 1) * vertex_chunk_));
+			});
+		}
+		else
+		{
+			shade(0, count);
+		}
+	}
+
+	void rasterizer::bound_tri(const rasterizer_node& node, face_data& face) const
+	{
+		vertex_data* data = face.data;
 
 		// Sort vertex data array based on vertex position
 		std::sort(data, data + 3, vertex_comparator_);
 
+		// Find conservative raster bounds, covering rounding and the scanline padding
+		const float min_x = std::min(std::min(data[0].pos.x(), data[1].pos.x()), data[2].pos.x());
+		const float max_x = std::max(std::max(data[0].pos.x(), data[1].pos.x()), data[2].pos.x());
+		const float min_y = std::min(std::min(data[0].pos.y(), data[1].pos.y()), data[2].pos.y());
+		const float max_y = std::max(std::max(data[0].pos.y(), data[1].pos.y()), data[2].pos.y());
+
+		// Clamp to one pixel outside the raster, so that degenerate positions can't overflow
+		const auto clamp_x = [this](const float x) { return static_cast<int>(std::min(std::max(-1.0f, x), static_cast<float>(width_))); };
+		const auto clamp_y = [this](const float y) { return static_cast<int>(std::min(std::max(-1.0f, y), static_cast<float>(height_))); };
+
+		face.min_x = clamp_x(std::floor(min_x) - 1);
+		face.max_x = clamp_x(std::ceil(max_x) + 1);
+		face.min_y = clamp_y(std::floor(min_y) - 1);
+		face.max_y = clamp_y(std::ceil(max_y) + 1);
+		face.node = &node;
+
+		// Fragments are interpolated linearly in screen-space, so the UV difference across any 2x2 pixel quad of the face
+		// is the same, and can be found once from the edges of the face
+		const float e1_x = data[1].pos.x() - data[0].pos.x(), e1_y = data[1].pos.y() - data[0].pos.y();
+		const float e2_x = data[2].pos.x() - data[0].pos.x(), e2_y = data[2].pos.y() - data[0].pos.y();
+		const float area = e1_x * e2_y - e2_x * e1_y;
+
+		if (area != 0)
+		{
+			const vector2 duv1 = data[1].uv - data[0].uv;
+			const vector2 duv2 = data[2].uv - data[0].uv;
+			face.uv_dx = (duv1 * e2_y - duv2 * e1_y) / area;
+			face.uv_dy = (duv2 * e1_x - duv1 * e2_x) / area;
+		}
+		else
+		{
+			face.uv_dx = vector2();
+			face.uv_dy = vector2();
+		}
+	}
+
+	unsigned rasterizer::clip_tri(const rasterizer_node& node, const vector4& face_normal, const unsigned* positions, const unsigned codes)
+	{
+		// Each plane adds at most one vertex to the polygon
+		vertex_data buffer[2][max_clip_vertices_];
+		vertex_data* in = buffer[0];
+		vertex_data* out = buffer[1];
+		int count = 3;
+
+		for (int i = 0; i < 3; i++)
+			in[i] = clip_cache_[positions[i]];
+
+		// Planes as (a, b, c, d), where a vertex is inside if ax + by + cz + dw >= 0
+		const vector4 planes[] =
+		{
+			vector4(0, 0, 1, 0),
+			vector4(1, 0, 0, guard_band_),
+			vector4(-1, 0, 0, guard_band_),
+			vector4(0, 1, 0, guard_band_),
+			vector4(0, -1, 0, guard_band_)
+		};
+
+		const unsigned flags[] = { clip_near, clip_guard_left, clip_guard_right, clip_guard_bottom, clip_guard_top };
+
+		for (int p = 0; p < 5; p++)
+		{
+			// Skip planes which no vertex of the face lies outside
+			if ((codes & flags[p]) == 0)
+				continue;
+
+			int n = 0;
+
+			for (int i = 0; i < count; i++)
+			{
+				const vertex_data& a = in[i];
+				const vertex_data& b = in[(i + 1) % count];
+				const float da = vector4::dot4(planes[p], a.pos);
+				const float db = vector4::dot4(planes[p], b.pos);
+
+				if (da >= 0)
+					out[n++] = a;
+
+				// Always interpolate from the inside vertex, so that faces sharing the edge get the same intersection
+				if (da >= 0 && db < 0)
+					out[n++] = lerp_vertex(a, b, da / (da - db));
+				else if (da < 0 && db >= 0)
+					out[n++] = lerp_vertex(b, a, db / (db - da));
+			}
+
+			std::swap(in, out);
+			count = n;
+
+			if (count < 3)
+				return 0;
+		}
+
+		for (int i = 0; i < count; i++)
+			convert_screenspace(in[i]);
+
+		// Split the clipped polygon into a fan of faces
+		for (int i = 1; i < count - 1; i++)
+		{
+			face_data& face = setup_faces_[i - 1];
+			face.data[0] = in[0];
+			face.data[1] = in[i];
+			face.data[2] = in[i + 1];
+			face.face_normal = face_normal;
+			bound_tri(node, face);
+		}
+
+		return static_cast<unsigned>(count - 2);
+	}
+
+	unsigned rasterizer::setup_tri(rasterizer_node& node, const vector4& camera_local, const unsigned index)
+	{
+		// Get model face vertices
+		const vector4 vertices[] =
+		{
+			node.get_position_by_index(index),
+			node.get_position_by_index(index + 1),
+			node.get_position_by_index(index + 2)
+		};
+
+		const vector4 face_normal = get_face_normal(vertices[0], vertices[1], vertices[2]);
+
+		// Exit early if normal is facing away from camera
+		if (cull_backface(vertices[0], face_normal, camera_local))
+			return 0;
+
+		const unsigned positions[] = { node.get_index(index), node.get_index(index + 1), node.get_index(index + 2) };
+		const unsigned c0 = clip_codes_[positions[0]];
+		const unsigned c1 = clip_codes_[positions[1]];
+		const unsigned c2 = clip_codes_[positions[2]];
+
+		// Exit early if all vertices are outside the same plane
+		if ((c0 & c1 & c2) != 0)
+		{
+			stats_.faces_outside++;
+			return 0;
+		}
+
+		// Faces crossing the near plane or the guard band are clipped in clip space
+		if (((c0 | c1 | c2) & clip_required) != 0)
+		{
+			stats_.faces_clipped++;
+			return clip_tri(node, face_normal, positions, c0 | c1 | c2);
+		}
+
+		// Assemble the face from vertices already shaded and converted to screen-space
+		face_data& face = setup_faces_[0];
+		face.data[0] = vertex_cache_[positions[0]];
+		face.data[1] = vertex_cache_[positions[1]];
+		face.data[2] = vertex_cache_[positions[2]];
+		face.face_normal = face_normal;
+		bound_tri(node, face);
+
+		return 1;
+	}
+
+	void rasterizer::fill_tri(const face_data& face, tile_data& tile)
+	{
+		const auto start = profile_start();
+
+		// Skip faces which are entirely hidden behind what has already been drawn
+		if (hiz_ && face_occluded(face, tile))
+		{
+			if (tile.batch.pass != pass_visible)
+				tile.stats.faces_occluded++;
+
+			if (profile_)
+				tile.timings.raster += elapsed_ms(start);
+
+			return;
+		}
+
+		tile.batch.node = face.node;
+		tile.batch.count = 0;
+		tile.batch.uv_dx = face.uv_dx;
+		tile.batch.uv_dy = face.uv_dy;
+
+		if (traversal_ == traversal_halfspace)
+			fill_halfspace(face, tile);
+		else
+			fill_scanlines(face, tile);
+
+		flush_fragments(tile.batch);
+
+		tile.stats.fragments_tested += tile.batch.tested;
+		tile.stats.fragments_occluded += tile.batch.occluded;
+		tile.stats.fragments_shaded += tile.batch.shaded;
+		tile.batch.tested = 0;
+		tile.batch.occluded = 0;
+		tile.batch.shaded = 0;
+
+		// Shading is timed separately, as it is interleaved with traversal whenever the batch fills up
+		if (profile_)
+		{
+			tile.timings.raster += elapsed_ms(start) - tile.batch.shade_time;
+			tile.timings.fragment += tile.batch.shade_time;
+			tile.batch.shade_time = 0;
+		}
+	}
+
+	void rasterizer::fill_scanlines(const face_data& face, tile_data& tile)
+	{
+		const vertex_data* data = face.data;
+
 		// Create line data based on sorted vertex data
 		line_data l1(data[0].pos, data[2].pos);
 		line_data l2(data[0].pos, data[1].pos);
@@ -163,7 +773,7 @@ namespace efiilj
 			{
 				point_data pt1 = get_point_on_line(l1);
 				point_data pt2 = get_point_on_line(l2);
-				fill_scanline(pt1, pt2, face_normal, node, data);
+				fill_scanline(pt1, pt2, face.face_normal, data, tile);
 			}
 		}
 
@@ -174,11 +784,53 @@ namespace efiilj
 			{
 				point_data pt1 = get_point_on_line(l1);
 				point_data pt2 = get_point_on_line(l3);
-				fill_scanline(pt1, pt2, face_normal, node, data);
+				fill_scanline(pt1, pt2, face.face_normal, data, tile);
 			}
 		}
 	}
 
+	void rasterizer::draw_tri(rasterizer_node& node, const vector4& camera_local, const unsigned index)
+	{
+		const auto start = profile_start();
+		const unsigned count = setup_tri(node, camera_local, index);
+
+		if (profile_)
+			timings_.setup += elapsed_ms(start);
+
+		for (unsigned i = 0; i < count; i++)
+		{
+			// Deferred shading and the depth pre-pass look faces up again in a second pass, so they are kept for the whole frame
+			if (deferred_ || prepass_)
+			{
+				screen_.batch.face = static_cast<unsigned>(faces_.size());
+				faces_.push_back(setup_faces_[i]);
+			}
+
+			fill_tri(setup_faces_[i], screen_);
+		}
+	}
+
+	void rasterizer::bin_tri(const face_data& face)
+	{
+		// Skip faces which are entirely outside the raster
+		if (face.max_x < 0 || face.max_y < 0 || face.min_x >= width_ || face.min_y >= height_)
+			return;
+
+		const auto index = static_cast<unsigned>(faces_.size());
+		faces_.push_back(face);
+
+		const int tx1 = std::max(face.min_x, 0) / tile_size_;
+		const int ty1 = std::max(face.min_y, 0) / tile_size_;
+		const int tx2 = std::min(face.max_x / tile_size_, tiles_x_ - 1);
+		const int ty2 = std::min(face.max_y / tile_size_, tiles_y_ - 1);
+
+		for (int ty = ty1; ty <= ty2; ty++)
+		{
+			for (int tx = tx1; tx <= tx2; tx++)
+				tiles_[tx + tiles_x_ * ty].faces.push_back(index);
+		}
+	}
+
 	void rasterizer::draw_line(line_data& line, const unsigned c)
 	{
 		// put initial pixel
@@ -216,7 +868,7 @@ namespace efiilj
 		line.reset();
 	}
 
-	vector3 rasterizer::get_barycentric(const float x, const float y, const vector4& face_normal, vertex_data* data)
+	vector3 rasterizer::get_barycentric(const float x, const float y, const vector4& face_normal, const vertex_data* data)
 	{
 		const float area = face_normal.length();
 
@@ -232,17 +884,17 @@ namespace efiilj
 		return vector3(p1, p2, p3);
 	}
 
-	vector3 rasterizer::get_barycentric(const vector4& point, const vector4& face_normal, vertex_data* data)
+	vector3 rasterizer::get_barycentric(const vector4& point, const vector4& face_normal, const vertex_data* data)
 	{
 		return get_barycentric(point.x(), point.y(), face_normal, data);
 	}
 
-	vector3 rasterizer::get_barycentric(const point_data& point, const vector4& face_normal, vertex_data* data)
+	vector3 rasterizer::get_barycentric(const point_data& point, const vector4& face_normal, const vertex_data* data)
 	{
 		return get_barycentric(static_cast<float>(point.x), static_cast<float>(point.y), face_normal, data);
 	}
 
-	vertex_data rasterizer::interpolate_fragment(const vector3& barycentric, vertex_data* data)
+	vertex_data rasterizer::interpolate_fragment(const vector3& barycentric, const vertex_data* data)
 	{
 		const vector4 position = data[0].pos * barycentric.x() + data[1].pos * barycentric.y() + data[2].pos * barycentric.z();
 		const vector4 fragment = data[0].fragment * barycentric.x() + data[1].fragment * barycentric.y() + data[2].fragment * barycentric.z();
@@ -316,20 +968,336 @@ namespace efiilj
 	{
 		std::fill(buffer_, buffer_ + width_ * height_, color_);
 		std::fill(depth_, depth_ + width_ * height_, 1);
+		std::fill(block_depth_.begin(), block_depth_.end(), 1.0f);
+		std::fill(block_dirty_.begin(), block_dirty_.end(), 0);
+	}
+
+	void rasterizer::set_deferred(const bool enabled)
+	{
+		deferred_ = enabled;
+
+		if (!enabled)
+		{
+			gbuffer_.clear();
+			return;
+		}
+
+		// The G-buffer is never cleared, as only pixels whose depth has been written are read back
+		gbuffer_.resize(static_cast<size_t>(width_) * height_);
+
+		if (!workers_)
+			workers_.reset(new worker_pool(threads_));
+	}
+
+	void rasterizer::set_depth_prepass(const bool enabled)
+	{
+		prepass_ = enabled;
+
+		// The visibility buffer is never cleared, as only pixels whose depth has been written are read back
+		if (enabled)
+			visibility_.resize(static_cast<size_t>(width_) * height_);
+		else
+			visibility_.clear();
+	}
+
+	unsigned rasterizer::count_drawn(const tile_data& region) const
+	{
+		unsigned count = 0;
+
+		for (int y = region.y1; y < region.y2; y++)
+		{
+			const float* depth = depth_ + width_ * y;
+
+			for (int x = region.x1; x < region.x2; x++)
+				count += depth[x] < 1;
+		}
+
+		return count;
+	}
+
+	void rasterizer::shade_gbuffer(tile_data& region)
+	{
+		fragment_batch& batch = region.batch;
+		const face_data* current = nullptr;
+		batch.count = 0;
+
+		for (int y = region.y1; y < region.y2; y++)
+		{
+			const gbuffer_texel* row = &gbuffer_[width_ * y];
+			const float* depth = depth_ + width_ * y;
+
+			for (int x = region.x1; x < region.x2; x++)
+			{
+				// Depth is cleared to 1, and only ever replaced by nearer fragments
+				if (!(depth[x] < 1))
+					continue;
+
+				const gbuffer_texel& texel = row[x];
+				const face_data& face = faces_[texel.face];
+
+				// Consecutive pixels of the same face share a node and UV gradients, and are shaded in one batch
+				if (&face != current)
+				{
+					flush_fragments(batch);
+
+					batch.node = face.node;
+					batch.uv_dx = face.uv_dx;
+					batch.uv_dy = face.uv_dy;
+					current = &face;
+				}
+
+				batch.x[batch.count] = x;
+				batch.y[batch.count] = y;
+				batch.data[batch.count] = vertex_data
+				{
+					vector4(static_cast<float>(x), static_cast<float>(y), depth[x], 1),
+					vector4(texel.fragment[0], texel.fragment[1], texel.fragment[2], 1),
+					vector4(texel.normal[0], texel.normal[1], texel.normal[2], 1),
+					vector4(1, 1, 1, 1),
+					texel.uv
+				};
+
+				if (++batch.count == fragment_batch::capacity)
+					flush_fragments(batch);
+			}
+		}
+
+		flush_fragments(batch);
+	}
+
+	void rasterizer::shade_deferred()
+	{
+		const auto start = profile_start();
+		const unsigned bands = static_cast<unsigned>((height_ + deferred_rows_ - 1) / deferred_rows_);
+		std::vector<unsigned> shaded(bands);
+
+		workers_->run(bands, [this, &shaded](const unsigned i)
+		{
+			tile_data band;
+			band.x1 = 0;
+			band.x2 = width_;
+			band.y1 = static_cast<int>(i) * deferred_rows_;
+			band.y2 = std::min(band.y1 + deferred_rows_, height_);
+			shade_gbuffer(band);
+			shaded[i] = band.batch.shaded;
+		});
+
+		for (const unsigned count : shaded)
+			stats_.fragments_shaded += count;
+
+		if (profile_)
+			timings_.fragment += elapsed_ms(start);
+	}
+
+	void rasterizer::order_nodes()
+	{
+		draw_order_.clear();
+
+		const vector4 eye = camera_->transform().position();
+
+		for (const auto& node_ptr : nodes_)
+		{
+			float distance = 0;
+
+			if (sort_nodes_)
+			{
+				// Scaling the sum of the corners would also halve w, and with it the translation of the model matrix
+				const bounding_box& bounds = node_ptr->bounds();
+				const vector4 sum = bounds.lower + bounds.upper;
+				const vector4 center(sum.x() * 0.5f, sum.y() * 0.5f, sum.z() * 0.5f, 1);
+
+				distance = vector4::dist(node_ptr->transform().model() * center, eye);
+			}
+
+			draw_order_.emplace_back(distance, node_ptr.get());
+		}
+
+		// Nodes at equal distance keep the order they were added in
+		if (sort_nodes_)
+		{
+			std::stable_sort(draw_order_.begin(), draw_order_.end(),
+			                 [](const std::pair<float, rasterizer_node*>& a, const std::pair<float, rasterizer_node*>& b) { return a.first < b.first; });
+		}
+	}
+
+	void rasterizer::fill_tile(tile_data& tile)
+	{
+		const bool prepass = prepass_ && !deferred_;
+		tile.batch.pass = prepass ? pass_depth : pass_color;
+
+		for (const unsigned face : tile.faces)
+		{
+			tile.batch.face = face;
+			fill_tri(faces_[face], tile);
+		}
+
+		if (!prepass)
+			return;
+
+		// Fill the faces again, now that the depth buffer holds the nearest fragment of each pixel
+		tile.batch.pass = pass_visible;
+
+		for (const unsigned face : tile.faces)
+		{
+			tile.batch.face = face;
+			fill_tri(faces_[face], tile);
+		}
+	}
+
+	void rasterizer::render_tiled()
+	{
+		stats_ = raster_stats();
+		timings_ = raster_timings();
+		faces_.clear();
+		for (auto& tile : tiles_)
+		{
+			tile.faces.clear();
+			tile.stats = raster_stats();
+			tile.timings = raster_timings();
+		}
+
+		order_nodes();
+
+		// Front-end: set up faces in draw order and bin them into tiles
+		for (const auto& entry : draw_order_)
+		{
+			rasterizer_node& node = *entry.second;
+			const vector4 camera_local = node.transform().model_inv() * camera_->transform().position();
+
+			// Skip nodes entirely outside the view frustum before any per-vertex work
+			if (!is_visible(node))
+			{
+				stats_.nodes_culled++;
+				continue;
+			}
+
+			auto start = profile_start();
+			transform_vertices(node);
+
+			if (profile_)
+			{
+				timings_.vertex += elapsed_ms(start);
+				start = profile_start();
+			}
+
+			for_each_face(node, camera_local, [&](const unsigned i)
+			{
+				const unsigned count = setup_tri(node, camera_local, i);
+
+				for (unsigned f = 0; f < count; f++)
+					bin_tri(setup_faces_[f]);
+			});
+
+			if (profile_)
+				timings_.setup += elapsed_ms(start);
+		}
+
+		// Back-end: each tile is owned by a single worker, so no locking is needed on the buffers
+		workers_->run(static_cast<unsigned>(tiles_.size()), [this](const unsigned i)
+		{
+			tile_data& tile = tiles_[i];
+			const auto start = profile_start();
+			clear(tile);
+
+			if (profile_)
+				tile.timings.clear += elapsed_ms(start);
+
+			fill_tile(tile);
+
+			// Tiles are disjoint, so each can be lit as soon as all of its faces have been filled
+			if (deferred_)
+			{
+				const auto shade_start = profile_start();
+				shade_gbuffer(tile);
+
+				tile.stats.fragments_shaded += tile.batch.shaded;
+				tile.batch.shaded = 0;
+
+				if (profile_)
+				{
+					tile.timings.fragment += elapsed_ms(shade_start);
+					tile.batch.shade_time = 0;
+				}
+			}
+
+			if (profile_)
+				tile.stats.pixels_drawn += count_drawn(tile);
+		});
+
+		for (const auto& tile : tiles_)
+		{
+			stats_ += tile.stats;
+			timings_ += tile.timings;
+		}
 	}
 
 	void rasterizer::render()
 	{
+		if (mode_ == raster_tiled)
+		{
+			render_tiled();
+			return;
+		}
+
+		const auto start = profile_start();
 		clear();
 
-		for (const auto& node_ptr : nodes_)
+		stats_ = raster_stats();
+		timings_ = raster_timings();
+		faces_.clear();
+		screen_.stats = raster_stats();
+		screen_.timings = raster_timings();
+		screen_.batch.pass = prepass_ && !deferred_ ? pass_depth : pass_color;
+
+		if (profile_)
+			timings_.clear += elapsed_ms(start);
+
+		order_nodes();
+
+		for (const auto& entry : draw_order_)
+		{
+			rasterizer_node& node = *entry.second;
+			const vector4 camera_local = node.transform().model_inv() * camera_->transform().position();
+
+			// Skip nodes entirely outside the view frustum before any per-vertex work
+			if (!is_visible(node))
+			{
+				stats_.nodes_culled++;
+				continue;
+			}
+
+			const auto vertex_start = profile_start();
+			transform_vertices(node);
+
+			if (profile_)
+				timings_.vertex += elapsed_ms(vertex_start);
+
+			for_each_face(node, camera_local, [&](const unsigned i)
+			{
+				draw_tri(node, camera_local, i);
+			});
+		}
+
+		if (deferred_)
+		{
+			shade_deferred();
+		}
+		else if (prepass_)
 		{
-			matrix4 local = node_ptr->transform().model_inv();
+			// Fill every face again, now that the depth buffer holds the nearest fragment of each pixel
+			screen_.batch.pass = pass_visible;
 
-			for (unsigned int i = 0; i < node_ptr->index_count(); i += 3)
+			for (unsigned i = 0; i < faces_.size(); i++)
 			{
-				draw_tri(*node_ptr, local, i);
+				screen_.batch.face = i;
+				fill_tri(faces_[i], screen_);
 			}
 		}
+
+		if (profile_)
+			screen_.stats.pixels_drawn = count_drawn(screen_);
+
+		stats_ += screen_.stats;
+		timings_ += screen_.timings;
 	}
 }
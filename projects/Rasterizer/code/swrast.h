@@ -4,13 +4,270 @@
 #include "camera.h"
 #include "rnode.h"
 #include "line.h"
+#include "workers.h"
 
 #include <vector>
+#include <memory>
+#include <utility>
 #include <algorithm>
 #include <functional>
+#include <chrono>
 
 namespace efiilj
-{	
+{
+	/**
+	 * \brief Selects how the rasterizer distributes work when rendering a frame.
+	 */
+	enum raster_mode
+	{
+		/**
+		 * \brief Every face is set up and filled in submission order on the calling thread.
+		 */
+		raster_serial,
+		/**
+		 * \brief Faces are set up and binned into screen tiles, which are then filled in parallel by a worker pool.
+		 */
+		raster_tiled
+	};
+
+	/**
+	 * \brief Selects the algorithm used to find the pixels covered by a face.
+	 */
+	enum raster_traversal
+	{
+		/**
+		 * \brief Walks the face edges with Bresenham lines and fills padded spans between them.
+		 */
+		traversal_scanline,
+		/**
+		 * \brief Steps integer edge functions over the face bounding box, using a top-left fill rule.
+		 */
+		traversal_halfspace
+	};
+
+	/**
+	 * \brief Selects what happens to the fragments of a face as it is filled.
+	 */
+	enum raster_pass
+	{
+		/**
+		 * \brief Fragments are depth tested, and shaded if they pass.
+		 */
+		pass_color,
+		/**
+		 * \brief Fragments are only depth tested, without interpolating their attributes, and the face of the nearest fragment is recorded for each pixel.
+		 */
+		pass_depth,
+		/**
+		 * \brief Fragments are shaded only if their face was recorded for the pixel by a depth pass, without depth testing.
+		 */
+		pass_visible
+	};
+
+	/**
+	 * \brief Flags describing which clip planes a vertex lies outside of, in homogeneous clip space.
+	 */
+	enum clip_flags
+	{
+		clip_near = 1 << 0,
+		clip_far = 1 << 1,
+		clip_left = 1 << 2,
+		clip_right = 1 << 3,
+		clip_bottom = 1 << 4,
+		clip_top = 1 << 5,
+		clip_guard_left = 1 << 6,
+		clip_guard_right = 1 << 7,
+		clip_guard_bottom = 1 << 8,
+		clip_guard_top = 1 << 9,
+
+		/**
+		 * \brief Planes which faces must be clipped against, rather than only rejected by.
+		 */
+		clip_required = clip_near | clip_guard_left | clip_guard_right | clip_guard_bottom | clip_guard_top
+	};
+
+	/**
+	 * \brief A face which has passed culling and been transformed to raster space, ready to be filled.
+	 */
+	struct face_data
+	{
+		vertex_data data[3];
+		vector4 face_normal;
+		const rasterizer_node* node;
+		int min_x, min_y, max_x, max_y;
+
+		/**
+		 * \brief The screen-space gradients of the UV coordinates across the face.
+		 */
+		vector2 uv_dx, uv_dy;
+	};
+
+	/**
+	 * \brief Counters describing the work skipped while rendering a frame.
+	 */
+	struct raster_stats
+	{
+		/**
+		 * \brief Faces rejected by the coarse depth buffer before any per-pixel work (counted once per tile in tiled mode).
+		 */
+		unsigned faces_occluded = 0;
+		/**
+		 * \brief 8x8 pixel blocks of a face rejected by the coarse depth buffer before any per-pixel work.
+		 */
+		unsigned blocks_occluded = 0;
+		/**
+		 * \brief Faces rejected for lying entirely outside one of the view volume planes.
+		 */
+		unsigned faces_outside = 0;
+		/**
+		 * \brief Faces which crossed the near plane or the guard band, and were clipped before being filled.
+		 */
+		unsigned faces_clipped = 0;
+		/**
+		 * \brief Nodes skipped because their bounding box lies entirely outside the view frustum.
+		 */
+		unsigned nodes_culled = 0;
+		/**
+		 * \brief Fragments covered by a face and tested against the depth buffer, once per face and pixel.
+		 */
+		unsigned fragments_tested = 0;
+		/**
+		 * \brief Fragments which failed the per-pixel depth test, and so were rejected before shading.
+		 */
+		unsigned fragments_occluded = 0;
+		/**
+		 * \brief Fragments run through a fragment shader.
+		 */
+		unsigned fragments_shaded = 0;
+		/**
+		 * \brief Pixels covered by a face at the end of the frame, only counted while profiling as it takes a pass over the depth buffer.
+		 * Dividing the tested and shaded fragments by this gives the depth complexity and shading overdraw of the frame.
+		 */
+		unsigned pixels_drawn = 0;
+
+		raster_stats& operator += (const raster_stats& other)
+		{
+			faces_occluded += other.faces_occluded;
+			blocks_occluded += other.blocks_occluded;
+			faces_outside += other.faces_outside;
+			faces_clipped += other.faces_clipped;
+			nodes_culled += other.nodes_culled;
+			fragments_tested += other.fragments_tested;
+			fragments_occluded += other.fragments_occluded;
+			fragments_shaded += other.fragments_shaded;
+			pixels_drawn += other.pixels_drawn;
+			return *this;
+		}
+	};
+
+	/**
+	 * \brief Time spent in each stage of the pipeline while rendering a frame, in milliseconds.
+	 * Only collected while profiling is enabled. In tiled mode, the clear, raster and fragment stages
+	 * are summed over all tiles, and so measure the total time of all workers rather than wall time.
+	 */
+	struct raster_timings
+	{
+		/**
+		 * \brief Clearing the raster, depth buffer and coarse depth buffer.
+		 */
+		double clear = 0;
+		/**
+		 * \brief Running the vertex shader and computing clip codes.
+		 */
+		double vertex = 0;
+		/**
+		 * \brief Culling, clipping and screen space conversion of faces, as well as binning them into tiles.
+		 */
+		double setup = 0;
+		/**
+		 * \brief Traversing faces, interpolating fragments and depth testing.
+		 */
+		double raster = 0;
+		/**
+		 * \brief Running the fragment shader and writing the resulting colors.
+		 */
+		double fragment = 0;
+
+		raster_timings& operator += (const raster_timings& other)
+		{
+			clear += other.clear;
+			vertex += other.vertex;
+			setup += other.setup;
+			raster += other.raster;
+			fragment += other.fragment;
+			return *this;
+		}
+	};
+
+	/**
+	 * \brief Fragments of a face which have passed depth testing, collected so that the node can shade them in a single call.
+	 */
+	struct fragment_batch
+	{
+		static const int capacity = 32;
+
+		const rasterizer_node* node = nullptr;
+		unsigned count = 0;
+
+		/**
+		 * \brief The position of the face in the face list of the frame, recorded in the G-buffer or visibility buffer.
+		 */
+		unsigned face = 0;
+
+		/**
+		 * \brief What is done with the fragments of the face.
+		 */
+		raster_pass pass = pass_color;
+
+		/**
+		 * \brief Fragments depth tested, rejected by the depth test and shaded since the face was started.
+		 */
+		unsigned tested = 0, occluded = 0, shaded = 0;
+
+		int x[capacity], y[capacity];
+		vertex_data data[capacity];
+		unsigned color[capacity];
+
+		/**
+		 * \brief The UV gradients of the face, passed on to the fragment shader.
+		 */
+		vector2 uv_dx, uv_dy;
+
+		/**
+		 * \brief Milliseconds spent shading the batch since the face was started, when profiling.
+		 */
+		double shade_time = 0;
+	};
+
+	/**
+	 * \brief The attributes of the nearest fragment of a pixel, written by the first pass of deferred shading.
+	 * The normal and world-space position are stored without w, which interpolation always sets to 1.
+	 * A texel is only valid if the depth of its pixel has been written since the raster was cleared.
+	 */
+	struct gbuffer_texel
+	{
+		float normal[3];
+		float fragment[3];
+		vector2 uv;
+
+		/**
+		 * \brief The position of the face in the face list of the frame, which holds its node and UV gradients.
+		 */
+		unsigned face;
+	};
+
+	/**
+	 * \brief A rectangular region of the raster (inclusive start, exclusive end) along with the faces that overlap it.
+	 */
+	struct tile_data
+	{
+		int x1, y1, x2, y2;
+		std::vector<unsigned> faces;
+		raster_stats stats;
+		raster_timings timings;
+		fragment_batch batch;
+	};
+	
 	class rasterizer
 	{
 	private:
@@ -20,7 +277,49 @@ namespace efiilj
 		float* depth_;
 		float x_offset_, y_offset_;
 
+		raster_mode mode_;
+		raster_traversal traversal_;
+		const int tile_size_ = 64;
+		const int subpixel_bits_ = 4;
+		const float halfspace_guard_ = 16777216.0f;
+		int simd_max_width_, simd_width_;
+
+		bool hiz_;
+		const int block_bits_ = 3;
+		const float hiz_epsilon_ = 1e-5f;
+		int blocks_x_, blocks_y_;
+		std::vector<float> block_depth_;
+		std::vector<unsigned char> block_dirty_;
+		raster_stats stats_;
+
+		bool profile_;
+		raster_timings timings_;
+
+		bool deferred_;
+		bool prepass_;
+		unsigned threads_;
+		const int deferred_rows_ = 16;
+		std::vector<gbuffer_texel> gbuffer_;
+		std::vector<unsigned> visibility_;
+		static const unsigned no_face_ = ~0u;
+
+		int tiles_x_, tiles_y_;
+		tile_data screen_;
+		std::vector<tile_data> tiles_;
+		std::vector<face_data> faces_;
+		std::vector<vertex_data> clip_cache_;
+		std::vector<vertex_data> vertex_cache_;
+		std::vector<unsigned short> clip_codes_;
+		const unsigned vertex_chunk_ = 1024;
+
+		static const int max_clip_vertices_ = 8;
+		const float guard_band_ = 2.0f;
+		face_data setup_faces_[max_clip_vertices_ - 2];
+		std::unique_ptr<worker_pool> workers_;
+
 		std::vector<std::shared_ptr<rasterizer_node>> nodes_;
+		std::vector<std::pair<float, rasterizer_node*>> draw_order_;
+		bool sort_nodes_, sort_faces_;
 		std::shared_ptr<camera_model> camera_;
 
 		std::function<bool(const vertex_data& a, const vertex_data& b)> vertex_comparator_ = [this](const vertex_data& a, const vertex_data& b)
@@ -43,6 +342,29 @@ namespace efiilj
 		 */
 		bool cull_backface(const vector4& p0, const vector4& face_normal, const vector4& camera_local) const;
 
+		/**
+		 * \brief Classifies a clip space position against the view volume and the guard band.
+		 * \param pos The clip space position
+		 * \return The clip_flags of all planes the position lies outside of
+		 */
+		unsigned short get_clip_code(const vector4& pos) const;
+
+		/**
+		 * \brief Tests the bounding box of a node against the camera view frustum.
+		 * \param node The graphics node which should be tested
+		 * \return True if the node may be visible, false if it lies entirely outside the frustum
+		 */
+		bool is_visible(rasterizer_node& node) const;
+
+		/**
+		 * \brief Linearly interpolates all attributes between two vertices.
+		 * \param a The vertex at t = 0
+		 * \param b The vertex at t = 1
+		 * \param t The interpolation factor
+		 * \return The interpolated vertex
+		 */
+		static vertex_data lerp_vertex(const vertex_data& a, const vertex_data& b, float t);
+
 		/**
 		 * \brief Tests a pixel against the Z-buffer, and stores the new value if it's closer to the camera.
 		 * \param x Placement on the X-axis
@@ -50,7 +372,42 @@ namespace efiilj
 		 * \param z Placement on the Z-axis
 		 * \return True if the pixel passes depth testing and should be drawn, false otherwise
 		 */
-		bool depth_test(int x, int y, float z) const;
+		bool depth_test(int x, int y, float z);
+
+		/**
+		 * \brief Marks the coarse depth of the 8x8 blocks covering a run of pixels as stale, after their depth was written.
+		 * \param x1 First written pixel on the X-axis
+		 * \param x2 Last written pixel on the X-axis
+		 * \param y Placement on the Y-axis
+		 */
+		void touch_blocks(int x1, int x2, int y)
+		{
+			unsigned char* row = &block_dirty_[blocks_x_ * (y >> block_bits_)];
+			row[x1 >> block_bits_] = 1;
+			row[x2 >> block_bits_] = 1;
+		}
+
+		/**
+		 * \brief Gets the farthest depth stored in an 8x8 block of the depth buffer, refreshing it first if the block has been written to.
+		 * \param bx Block placement on the X-axis
+		 * \param by Block placement on the Y-axis
+		 * \return The maximum depth value within the block
+		 */
+		float block_depth(int bx, int by);
+
+		/**
+		 * \brief Tests a face against the coarse depth buffer.
+		 * \param face The face which should be tested
+		 * \param tile The region of the raster which is being rendered
+		 * \return True if the face lies behind every block it overlaps within the region, false otherwise
+		 */
+		bool face_occluded(const face_data& face, const tile_data& tile);
+
+		/**
+		 * \brief Clears a region of the raster and depth buffer using the background color.
+		 * \param tile The region which should be cleared
+		 */
+		void clear(const tile_data& tile);
 
 		/**
 		 * \brief Places a pixel on the specified location, with the specified color
@@ -65,18 +422,275 @@ namespace efiilj
 		 * \param start Start point of line
 		 * \param end End point of line
 		 * \param face_normal The face normal which should be used to calculate the barycentric coordinates
-		 * \param node The graphics node currently being rendered
 		 * \param data The current vertex data (3 vertices in raster space)
+		 * \param tile The region of the raster which may be written to
+		 */
+		void fill_scanline(const point_data& start, const point_data& end, const vector4& face_normal, const vertex_data* data, tile_data& tile);
+
+		/**
+		 * \brief Fills a span of a scanline one pixel at a time, running the fragment shader for each covered pixel.
+		 * \param y Placement on the Y-axis
+		 * \param x1 First pixel of the span on the X-axis
+		 * \param x2 Pixel after the last in the span on the X-axis
+		 * \param face_normal The face normal which should be used to calculate the barycentric coordinates
+		 * \param data The current vertex data (3 vertices in raster space)
+		 * \param batch The fragment batch of the face
+		 */
+		void fill_span(int y, int x1, int x2, const vector4& face_normal, const vertex_data* data, fragment_batch& batch);
+
+		/**
+		 * \brief Fills a span of a scanline four pixels at a time using SSE, testing coverage and depth for all four at once.
+		 * Produces the same result as fill_span().
+		 * \param y Placement on the Y-axis
+		 * \param x1 First pixel of the span on the X-axis
+		 * \param x2 Pixel after the last in the span on the X-axis
+		 * \param face_normal The face normal which should be used to calculate the barycentric coordinates
+		 * \param data The current vertex data (3 vertices in raster space)
+		 * \param batch The fragment batch of the face
+		 */
+		void fill_span_sse(int y, int x1, int x2, const vector4& face_normal, const vertex_data* data, fragment_batch& batch);
+
+		/**
+		 * \brief Fills a span of a scanline eight pixels at a time using AVX2, testing coverage and depth for all eight at once.
+		 * Produces the same result as fill_span(), but must only be called if the CPU supports AVX2.
+		 * \param y Placement on the Y-axis
+		 * \param x1 First pixel of the span on the X-axis
+		 * \param x2 Pixel after the last in the span on the X-axis
+		 * \param face_normal The face normal which should be used to calculate the barycentric coordinates
+		 * \param data The current vertex data (3 vertices in raster space)
+		 * \param batch The fragment batch of the face
+		 */
+		void fill_span_avx2(int y, int x1, int x2, const vector4& face_normal, const vertex_data* data, fragment_batch& batch);
+
+		/**
+		 * \brief Shades the pixels of a SIMD span which passed the depth test, one at a time.
+		 * Kept out of line, so that the AVX2 span does not leave the upper halves of its registers in use while shading.
+		 * \param x The first pixel of the lanes on the X-axis
+		 * \param y Placement on the Y-axis
+		 * \param bits A mask of the lanes to shade
+		 * \param lanes The number of lanes
+		 * \param weights The barycentric weights of each lane, as three arrays of lanes floats
+		 * \param data The current vertex data (3 vertices in raster space)
+		 * \param batch The fragment batch of the face
+		 */
+		void shade_lanes(int x, int y, int bits, int lanes, const float* weights, const vertex_data* data, fragment_batch& batch);
+
+		/**
+		 * \brief Queues a fragment which has passed depth testing for shading, shading the batch if it is full.
+		 * \param x Placement on the X-axis
+		 * \param y Placement on the Y-axis
+		 * \param fragment The interpolated fragment data
+		 * \param batch The fragment batch of the face
+		 */
+		void write_fragment(const int x, const int y, const vertex_data& fragment, fragment_batch& batch)
+		{
+			if (deferred_)
+			{
+				write_gbuffer(x, y, fragment, batch.face);
+				return;
+			}
+
+			batch.x[batch.count] = x;
+			batch.y[batch.count] = y;
+			batch.data[batch.count] = fragment;
+
+			if (++batch.count == fragment_batch::capacity)
+				flush_fragments(batch);
+		}
+
+		/**
+		 * \brief Stores the attributes of a fragment which has passed depth testing in the G-buffer, replacing any fragment behind it.
+		 * \param x Placement on the X-axis
+		 * \param y Placement on the Y-axis
+		 * \param fragment The interpolated fragment data
+		 * \param face The position of the face in the face list of the frame
+		 */
+		void write_gbuffer(const int x, const int y, const vertex_data& fragment, const unsigned face)
+		{
+			gbuffer_texel& texel = gbuffer_[x + width_ * y];
+
+			for (int i = 0; i < 3; i++)
+			{
+				texel.normal[i] = fragment.normal.at(i);
+				texel.fragment[i] = fragment.fragment.at(i);
+			}
+
+			texel.uv = fragment.uv;
+			texel.face = face;
+		}
+
+		/**
+		 * \brief Checks whether a face is the one recorded for a pixel by the depth pass, and if so clears the record,
+		 * so that the pixel is shaded once even where the traversal covers it twice.
+		 * Records are only valid where depth has been written since the raster was cleared, as the visibility buffer is never cleared.
+		 * \param x Placement on the X-axis
+		 * \param y Placement on the Y-axis
+		 * \param face The position of the face in the face list of the frame
+		 * \return True if the fragment of the face should be shaded, false otherwise
+		 */
+		bool take_visible(const int x, const int y, const unsigned face)
+		{
+			const int index = x + width_ * y;
+
+			if (visibility_[index] != face || !(depth_[index] < 1))
+				return false;
+
+			visibility_[index] = no_face_;
+			return true;
+		}
+
+		/**
+		 * \brief Lists the nodes in the order they should be drawn, sorted front to back by the distance from the camera
+		 * to the center of their bounding box if node sorting is enabled, or in the order they were added otherwise.
+		 */
+		void order_nodes();
+
+		/**
+		 * \brief Calls a function with the first index of each face of a node, in the order the faces should be drawn.
+		 * If face sorting is enabled, the clusters of the node are visited front to back for the direction from the camera to the node.
+		 * \param node The node whose faces should be visited
+		 * \param camera_local The position of the camera in the local space of the node
+		 * \param func The function to call with each index, as void(unsigned)
+		 */
+		template <typename F>
+		void for_each_face(rasterizer_node& node, const vector4& camera_local, F func) const
+		{
+			const unsigned count = node.index_count();
+
+			if (!sort_faces_)
+			{
+				for (unsigned i = 0; i < count; i += 3)
+					func(i);
+
+				return;
+			}
+
+			const bounding_box& bounds = node.bounds();
+			const vector4 direction = (bounds.lower + bounds.upper) * 0.5f - camera_local;
+
+			for (const unsigned cluster : node.cluster_order(direction))
+			{
+				const unsigned first = cluster * rasterizer_node::cluster_faces * 3;
+				const unsigned last = std::min(first + rasterizer_node::cluster_faces * 3, count);
+
+				for (unsigned i = first; i < last; i += 3)
+					func(i);
+			}
+		}
+
+		/**
+		 * \brief Counts the pixels of a region covered by a face, by finding those whose depth has been written.
+		 * \param region The region of the raster to count
+		 * \return The number of covered pixels
+		 */
+		unsigned count_drawn(const tile_data& region) const;
+
+		/**
+		 * \brief Runs the fragment shaders for the visible fragments stored in the G-buffer within a region, once per pixel.
+		 * Runs of pixels from the same face are shaded in batches, as in forward shading.
+		 * \param region The region of the raster which should be shaded
+		 */
+		void shade_gbuffer(tile_data& region);
+
+		/**
+		 * \brief Runs the fragment shader of the batch node for all queued fragments, and puts the results in the raster.
+		 * \param batch The fragment batch which should be shaded and emptied
+		 */
+		void flush_fragments(fragment_batch& batch);
+
+		/**
+		 * \brief Interpolates and depth tests a single fragment of a face, queuing it for shading if it passes.
+		 * \param x Placement on the X-axis
+		 * \param y Placement on the Y-axis
+		 * \param bc The barycentric weights of the fragment
+		 * \param data The current vertex data (3 vertices in raster space)
+		 * \param batch The fragment batch of the face
+		 */
+		void shade_fragment(int x, int y, const vector3& bc, const vertex_data* data, fragment_batch& batch);
+
+		/**
+		 * \brief Fills a face one scanline at a time by walking its edges, limited to the specified region.
+		 * \param face The face which should be filled
+		 * \param tile The region of the raster which may be written to
+		 */
+		void fill_scanlines(const face_data& face, tile_data& tile);
+
+		/**
+		 * \brief Fills a face by stepping integer edge functions over its bounding box, limited to the specified region.
+		 * \param face The face which should be filled
+		 * \param tile The region of the raster which may be written to
+		 */
+		void fill_halfspace(const face_data& face, tile_data& tile);
+
+		/**
+		 * \brief Runs the vertex shader once for every vertex of a node, and stores the results in both clip space and raster space.
+		 * In tiled mode the vertices are shaded in parallel chunks.
+		 * \param node The graphics node which is currently being rendered
+		 */
+		void transform_vertices(rasterizer_node& node);
+
+		/**
+		 * \brief Finishes a face assembled in raster space, by sorting its vertices and finding its raster bounds.
+		 * \param node The graphics node which the face belongs to
+		 * \param face The face which should be finished
+		 */
+		void bound_tri(const rasterizer_node& node, face_data& face) const;
+
+		/**
+		 * \brief Clips a face against the near plane and guard band in clip space (Sutherland-Hodgman), and splits the result into faces.
+		 * \param node The graphics node which the face belongs to
+		 * \param face_normal The face normal of the face
+		 * \param positions The vertex cache positions of the face vertices
+		 * \param codes The combined clip_flags of the face vertices
+		 * \return The number of faces written to the setup buffer
+		 */
+		unsigned clip_tri(const rasterizer_node& node, const vector4& face_normal, const unsigned* positions, unsigned codes);
+
+		/**
+		 * \brief Culls and clips a face of the specified node and assembles it from the vertex cache, using three vertices starting with the specified index.
+		 * \param node The graphics node which is currently being rendered
+		 * \param camera_local The camera position in node local space, used for backface culling
+		 * \param index The first index of the face (out of 3)
+		 * \return The number of faces written to the setup buffer (more than one if the face was clipped)
 		 */
-		void fill_scanline(const point_data& start, const point_data& end, const vector4& face_normal, const rasterizer_node& node, vertex_data* data);
+		unsigned setup_tri(rasterizer_node& node, const vector4& camera_local, unsigned index);
+
+		/**
+		 * \brief Fills a face which has been set up in raster space, limited to the specified region.
+		 * \param face The face which should be filled
+		 * \param tile The region of the raster which may be written to
+		 */
+		void fill_tri(const face_data& face, tile_data& tile);
 
 		/**
 		 * \brief Draws an isolated face of the specified node, using three vertices starting with the specified index
 		 * \param node The graphics node which is currently being rendered
-		 * \param local The node world-to-local matrix used for backface culling
+		 * \param camera_local The camera position in node local space, used for backface culling
 		 * \param index The first index of the face (out of 3)
 		 */
-		void draw_tri(rasterizer_node& node, const matrix4& local, unsigned index);
+		void draw_tri(rasterizer_node& node, const vector4& camera_local, unsigned index);
+
+		/**
+		 * \brief Adds a face to the bins of every tile its bounds overlap.
+		 * \param face The face which should be binned
+		 */
+		void bin_tri(const face_data& face);
+
+		/**
+		 * \brief Renders all nodes by binning faces into tiles, and filling the tiles in parallel.
+		 */
+		void render_tiled();
+
+		/**
+		 * \brief Runs the lighting pass of deferred shading over the whole raster, in bands of rows shaded in parallel.
+		 */
+		void shade_deferred();
+
+		/**
+		 * \brief Fills the faces binned into a tile, in one pass or as a depth pass followed by a shading pass.
+		 * \param tile The tile which should be filled
+		 */
+		void fill_tile(tile_data& tile);
 
 		/**
 		 * \brief Debug function for drawing a line of the specified color directly on the raster.
@@ -93,7 +707,7 @@ namespace efiilj
 		 * \param data The vertex data in transformed raster space
 		 * \return A vector3 with the vertex corresponding barycentric weights
 		 */
-		static vector3 get_barycentric(float x, float y, const vector4& face_normal, vertex_data* data);
+		static vector3 get_barycentric(float x, float y, const vector4& face_normal, const vertex_data* data);
 
 		/**
 		 * \brief Calculates the barycentric weights of a single point inside (or outside) a face.
@@ -102,7 +716,7 @@ namespace efiilj
 		 * \param data The vertex data in transformed raster space
 		 * \return A vector3 with the vertex corresponding barycentric weights
 		 */
-		static vector3 get_barycentric(const vector4& point, const vector4& face_normal, vertex_data* data);
+		static vector3 get_barycentric(const vector4& point, const vector4& face_normal, const vertex_data* data);
 
 		/**
 		 * \brief Calculates the barycentric weights of a single point inside (or outside) a face.
@@ -111,7 +725,7 @@ namespace efiilj
 		 * \param data The vertex data in transformed raster space
 		 * \return A vector3 with the vertex corresponding barycentric weights
 		 */
-		static vector3 get_barycentric(const point_data& point, const vector4& face_normal, vertex_data* data);
+		static vector3 get_barycentric(const point_data& point, const vector4& face_normal, const vertex_data* data);
 
 		/**
 		 * \brief Creates an interpolated vertex_data object using barycentric weights and face vertex data.
@@ -119,7 +733,35 @@ namespace efiilj
 		 * \param data The vertex data of the triangle
 		 * \return A vertex data object representing a single, interpolated fragment on a face
 		 */
-		static vertex_data interpolate_fragment(const vector3& barycentric, vertex_data* data);
+		static vertex_data interpolate_fragment(const vector3& barycentric, const vertex_data* data);
+
+		/**
+		 * \brief Interpolates only the depth of a fragment, with the same result as the position depth of interpolate_fragment().
+		 * \param barycentric The barycentric weight vector of the point-on-face
+		 * \param data The vertex data of the triangle
+		 * \return The depth of the fragment
+		 */
+		static float interpolate_depth(const vector3& barycentric, const vertex_data* data)
+		{
+			return data[0].pos.z() * barycentric.x() + data[1].pos.z() * barycentric.y() + data[2].pos.z() * barycentric.z();
+		}
+
+		/**
+		 * \brief Creates an interpolated vertex_data object using barycentric weights, interpolating each attribute with SSE.
+		 * Produces the same result as interpolate_fragment().
+		 * \param b0 The barycentric weight of the first vertex
+		 * \param b1 The barycentric weight of the second vertex
+		 * \param b2 The barycentric weight of the third vertex
+		 * \param data The vertex data of the triangle
+		 * \return A vertex data object representing a single, interpolated fragment on a face
+		 */
+		static vertex_data interpolate_fragment_sse(float b0, float b1, float b2, const vertex_data* data);
+
+		/**
+		 * \brief Checks whether the CPU and operating system support AVX2 instructions.
+		 * \return True if AVX2 code paths may be used, false otherwise
+		 */
+		static bool cpu_has_avx2();
 
 		/**
 		 * \brief Returns the face normal of a face represented by three vectors.
@@ -146,6 +788,25 @@ namespace efiilj
 		 */
 		static point_data get_point_on_line(line_data& line);
 
+		/**
+		 * \brief Gets the starting point of a timed stage, without reading the clock unless profiling is enabled.
+		 * \return The current time if profiling, or the clock epoch otherwise
+		 */
+		std::chrono::steady_clock::time_point profile_start() const
+		{
+			return profile_ ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+		}
+
+		/**
+		 * \brief Gets the number of milliseconds elapsed since a point in time.
+		 * \param start The point in time to measure from
+		 * \return The elapsed time in milliseconds
+		 */
+		static double elapsed_ms(const std::chrono::steady_clock::time_point& start)
+		{
+			return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		}
+
 		
 	public:
 		
@@ -155,8 +816,10 @@ namespace efiilj
 		 * \param width The width of the rasterizer canvas in pixels
 		 * \param camera A pointer to an active camera instance
 		 * \param color The background color of the canvas
+		 * \param mode Whether to render serially, or in parallel screen tiles
+		 * \param threads The number of threads used in tiled mode (0 = hardware concurrency)
 		 */
-		rasterizer(int height, int width, std::shared_ptr<camera_model> camera, unsigned color = 0);
+		rasterizer(int height, int width, std::shared_ptr<camera_model> camera, unsigned color = 0, raster_mode mode = raster_serial, unsigned threads = 0);
 		~rasterizer();
 
 		void add_node(std::shared_ptr<rasterizer_node> node) { nodes_.emplace_back(std::move(node)); }
@@ -167,6 +830,92 @@ namespace efiilj
 		unsigned* get_frame_buffer() const { return buffer_; }
 		float* get_depth_buffer() const { return depth_; }
 
+		raster_mode get_mode() const { return mode_; }
+
+		raster_traversal get_traversal() const { return traversal_; }
+		void set_traversal(const raster_traversal traversal) { traversal_ = traversal; }
+
+		/**
+		 * \brief Gets the number of pixels the scanline traversal tests per iteration (1 = scalar, 4 = SSE, 8 = AVX2).
+		 * \return The current SIMD width
+		 */
+		int get_simd_width() const { return simd_width_; }
+
+		/**
+		 * \brief Enables or disables the SIMD scanline path. When enabled, AVX2 is used if the CPU supports it, and SSE otherwise.
+		 * \param enabled Whether to use SIMD, or fall back to scalar code
+		 */
+		void set_simd(const bool enabled) { simd_width_ = enabled ? simd_max_width_ : 1; }
+
+		bool get_hiz() const { return hiz_; }
+
+		/**
+		 * \brief Enables or disables rejection of occluded faces and 8x8 blocks against the coarse depth buffer.
+		 * \param enabled Whether to test against the coarse depth buffer before per-pixel work
+		 */
+		void set_hiz(const bool enabled) { hiz_ = enabled; }
+
+		/**
+		 * \brief Gets the counters collected while rendering the last frame.
+		 * \return The statistics of the last frame
+		 */
+		const raster_stats& get_stats() const { return stats_; }
+
+		bool get_profile() const { return profile_; }
+
+		/**
+		 * \brief Enables or disables measuring the time spent in each stage of the pipeline.
+		 * \param enabled Whether to collect stage timings while rendering
+		 */
+		void set_profile(const bool enabled) { profile_ = enabled; }
+
+		/**
+		 * \brief Gets the stage timings collected while rendering the last frame, if profiling is enabled.
+		 * \return The stage timings of the last frame
+		 */
+		const raster_timings& get_timings() const { return timings_; }
+
+		bool get_deferred() const { return deferred_; }
+
+		/**
+		 * \brief Enables or disables deferred shading. When enabled, filling faces only writes depth and a G-buffer
+		 * (normal, world-space position, UV and face), and fragment shaders run once per visible pixel in a second pass,
+		 * so that overdrawn fragments are never shaded. Fragment shaders then receive white as the vertex color,
+		 * and the raster position of the pixel. The second pass runs in parallel on the worker pool, which is created if needed.
+		 * \param enabled Whether to defer fragment shading until all faces have been filled
+		 */
+		void set_deferred(bool enabled);
+
+		bool get_depth_prepass() const { return prepass_; }
+
+		/**
+		 * \brief Enables or disables the depth pre-pass. When enabled, all faces are first filled depth-only, recording the face
+		 * of the nearest fragment of each pixel in a visibility buffer, and then filled again shading only the recorded fragments,
+		 * so that each pixel is shaded once. Unlike deferred shading, fragment shaders receive all attributes. Has no effect while
+		 * deferred shading is enabled. Comparing the shaded fragments in the stats with and without it shows whether it pays off.
+		 * \param enabled Whether to fill faces in a depth pass before shading them
+		 */
+		void set_depth_prepass(bool enabled);
+
+		bool get_sort_nodes() const { return sort_nodes_; }
+
+		/**
+		 * \brief Enables or disables drawing nodes front to back, sorted each frame by the distance from the camera to their bounds.
+		 * Nearer nodes then fill the depth buffer first, so that more of the fragments behind them are rejected before shading.
+		 * \param enabled Whether to sort nodes by distance, or draw them in the order they were added
+		 */
+		void set_sort_nodes(const bool enabled) { sort_nodes_ = enabled; }
+
+		bool get_sort_faces() const { return sort_faces_; }
+
+		/**
+		 * \brief Enables or disables drawing the faces of each node front to back, in clusters pre-sorted by the node
+		 * for the axis direction closest to the direction from the camera to the node.
+		 * Changes which face wins where faces are at equal depth, as they are drawn in a different order.
+		 * \param enabled Whether to draw face clusters sorted by view direction, or faces in index order
+		 */
+		void set_sort_faces(const bool enabled) { sort_faces_ = enabled; }
+
 		/**
 		 * \brief Clears the raster and depth buffer using the background color.
 		 */
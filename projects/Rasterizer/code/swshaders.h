@@ -0,0 +1,172 @@
+#pragma once
+
+#include "rnode.h"
+#include "color.h"
+#include "swfixed.h"
+
+#include <cmath>
+#include <algorithm>
+
+namespace efiilj
+{
+	/**
+	 * \brief Vertex shader which transforms vertices by the model and camera matrices, passing on world-space position and normal.
+	 * Intended for use with pipeline_node, so that it can be inlined.
+	 */
+	struct phong_vertex_shader
+	{
+		vertex_data operator()(vertex* vert, const vertex_uniforms& uniforms) const
+		{
+			vertex_data data;
+			data.pos = uniforms.camera * uniforms.model * vert->xyzw;
+			data.uv = vert->uv;
+			data.color = vert->rgba;
+			data.normal = uniforms.normal * vert->normal;
+			data.fragment = (uniforms.model * data.pos);
+
+			return data;
+		}
+
+		/**
+		 * \brief Shades a range of a vertex stream, transforming several vertices at once. The output is identical to the per-vertex shader.
+		 * \param stream The vertex stream of the node
+		 * \param first The first vertex which should be shaded
+		 * \param count The number of vertices to shade
+		 * \param uniforms The vertex shader uniforms
+		 * \param out Receives the vertex shader output for each vertex in the range
+		 */
+		void operator()(const vertex_stream& stream, const unsigned first, const unsigned count, const vertex_uniforms& uniforms, vertex_data* out) const
+		{
+			const unsigned block_size = 64;
+			const matrix4 mvp = uniforms.camera * uniforms.model;
+
+			float pos[4][block_size], normal[4][block_size], fragment[4][block_size];
+			float* const pos_out[4] = { pos[0], pos[1], pos[2], pos[3] };
+			float* const normal_out[4] = { normal[0], normal[1], normal[2], normal[3] };
+			float* const fragment_out[4] = { fragment[0], fragment[1], fragment[2], fragment[3] };
+
+			for (unsigned start = 0; start < count; start += block_size)
+			{
+				const unsigned offset = first + start;
+				const unsigned size = std::min(block_size, count - start);
+
+				const float* const pos_in[3] = { stream.get(stream_pos_x) + offset, stream.get(stream_pos_y) + offset, stream.get(stream_pos_z) + offset };
+				const float* const normal_in[3] = { stream.get(stream_normal_x) + offset, stream.get(stream_normal_y) + offset, stream.get(stream_normal_z) + offset };
+
+				const float* const clip_in[4] = { pos[0], pos[1], pos[2], pos[3] };
+
+				vertex_stream::transform(mvp, pos_in, 1, size, pos_out);
+				vertex_stream::transform(uniforms.normal, normal_in, 1, size, normal_out);
+				vertex_stream::transform(uniforms.model, clip_in, size, fragment_out);
+
+				const float* r = stream.get(stream_color_r) + offset;
+				const float* g = stream.get(stream_color_g) + offset;
+				const float* b = stream.get(stream_color_b) + offset;
+				const float* a = stream.get(stream_color_a) + offset;
+				const float* u = stream.get(stream_uv_u) + offset;
+				const float* v = stream.get(stream_uv_v) + offset;
+
+				for (unsigned i = 0; i < size; i++)
+				{
+					vertex_data& data = out[start + i];
+					data.pos = vector4(pos[0][i], pos[1][i], pos[2][i], pos[3][i]);
+					data.uv = vector2(u[i], v[i]);
+					data.color = vector4(r[i], g[i], b[i], a[i]);
+					data.normal = vector4(normal[0][i], normal[1][i], normal[2][i], normal[3][i]);
+					data.fragment = vector4(fragment[0][i], fragment[1][i], fragment[2][i], fragment[3][i]);
+				}
+			}
+		}
+	};
+
+	/**
+	 * \brief Computes the Phong light factor of a fragment lit by the single point light of the uniforms.
+	 * \param normal The interpolated normal of the fragment
+	 * \param fragment The world-space position of the fragment
+	 * \param uniforms The fragment shader uniforms
+	 * \return The factor which the color of each channel is multiplied by
+	 */
+	inline vector4 phong_light(const vector4& normal, const vector4& fragment, const fragment_uniforms& uniforms)
+	{
+		const vector4 ambient = uniforms.ambient_color * uniforms.ambient_strength;
+		const vector4 norm = normal.norm();
+		const vector4 light_dir = (uniforms.light_position - fragment).norm();
+		const vector4 view_dir = (uniforms.camera_position - fragment).norm();
+		const vector4 reflect_dir = (light_dir * -1).getReflection(norm);
+
+		const float diff = std::max(vector4::dot(norm, light_dir), 0.0f);
+		const vector4 diffuse = uniforms.light_rgba * diff;
+
+		const float spec = pow(std::max(vector4::dot(view_dir, reflect_dir), 0.0f), uniforms.shininess);
+		const vector4 specular = uniforms.light_rgba * uniforms.specular_strength * spec;
+
+		return ambient + diffuse + specular;
+	}
+
+	/**
+	 * \brief Fragment shader which samples the node texture, and lights it with a single point light (Phong).
+	 * Intended for use with pipeline_node, so that it can be inlined.
+	 */
+	struct phong_fragment_shader
+	{
+		unsigned operator()(const vertex_data& data, const texture_data& texture, const fragment_uniforms& uniforms) const
+		{
+			const vector4 col = texture.sample(data.uv, uniforms.uv_dx, uniforms.uv_dy);
+			const vector4 result = phong_light(uniforms.normal, uniforms.fragment, uniforms) * col;
+
+			return color
+			(
+				static_cast<unsigned char>(result.x()),
+				static_cast<unsigned char>(result.y()),
+				static_cast<unsigned char>(result.z()),
+				static_cast<unsigned char>(result.w())
+			);
+		}
+	};
+
+	/**
+	 * \brief Fragment shader approximating the lighting of phong_fragment_shader in fixed point (see fixed_phong),
+	 * which keeps texels packed as RGBA8 and modulates them by the light factors, saturating overbright channels instead of wrapping them.
+	 * Only the light, surface and view directions are normalized in floating-point. Shades whole fragment batches when used with pipeline_node.
+	 */
+	struct phong_fixed_fragment_shader
+	{
+		unsigned operator()(const vertex_data& data, const texture_data& texture, const fragment_uniforms& uniforms) const
+		{
+			unsigned result;
+			(*this)(&data, 1, texture, uniforms, &result);
+			return result;
+		}
+
+		/**
+		 * \brief Shades a number of fragments at once.
+		 * \param fragments The interpolated fragment data
+		 * \param count The number of fragments to shade
+		 * \param texture The node texture
+		 * \param uniforms The fragment shader uniforms, whose per-fragment values are read from the fragments instead
+		 * \param out Receives the packed color of each fragment
+		 */
+		void operator()(const vertex_data* fragments, const unsigned count, const texture_data& texture, const fragment_uniforms& uniforms, unsigned* out) const
+		{
+			const unsigned block_size = 32;
+			fixed_light light[block_size];
+
+			const fixed_phong& phong = fixed_phong::cached(uniforms.ambient_color * uniforms.ambient_strength, uniforms.light_rgba,
+			                                               uniforms.specular_strength, uniforms.shininess);
+
+			for (unsigned start = 0; start < count; start += block_size)
+			{
+				const unsigned size = std::min(block_size, count - start);
+
+				for (unsigned i = 0; i < size; i++)
+				{
+					const vertex_data& data = fragments[start + i];
+					out[start + i] = texture.sample_packed(data.uv, uniforms.uv_dx, uniforms.uv_dy);
+					light[i] = phong.shade(data.normal, data.fragment, uniforms.light_position, uniforms.camera_position);
+				}
+
+				modulate_texels(out + start, light, size, out + start);
+			}
+		}
+	};
+}
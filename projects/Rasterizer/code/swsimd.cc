@@ -0,0 +1,275 @@
+#include "swrast.h"
+
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#define AVX2_TARGET
+#define NO_INLINE __declspec(noinline)
+#else
+#define AVX2_TARGET __attribute__((target("avx2")))
+#define NO_INLINE __attribute__((noinline))
+#endif
+
+namespace efiilj
+{
+	namespace
+	{
+		/**
+		 * \brief Counts the lanes set in a movemask result.
+		 */
+		unsigned count_lanes(int bits)
+		{
+			unsigned count = 0;
+
+			for (; bits != 0; bits &= bits - 1)
+				count++;
+
+			return count;
+		}
+	}
+
+	bool rasterizer::cpu_has_avx2()
+	{
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7)
+			return false;
+
+		// The OS must have enabled saving of the YMM registers (OSXSAVE, and XMM + YMM state in XCR0)
+		__cpuid(info, 1);
+		if ((info[2] & (1 << 27)) == 0 || (_xgetbv(0) & 6) != 6)
+			return false;
+
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#elif defined(__GNUC__)
+		return __builtin_cpu_supports("avx2") != 0;
+#else
+		return false;
+#endif
+	}
+
+	vertex_data rasterizer::interpolate_fragment_sse(const float b0, const float b1, const float b2, const vertex_data* data)
+	{
+		const __m128 w0 = _mm_set1_ps(b0);
+		const __m128 w1 = _mm_set1_ps(b1);
+		const __m128 w2 = _mm_set1_ps(b2);
+
+		const auto lerp = [&](const vector4& a, const vector4& b, const vector4& c)
+		{
+			float out[4];
+			_mm_storeu_ps(out, _mm_add_ps(_mm_add_ps(
+				_mm_mul_ps(_mm_loadu_ps(&a.x()), w0),
+				_mm_mul_ps(_mm_loadu_ps(&b.x()), w1)),
+				_mm_mul_ps(_mm_loadu_ps(&c.x()), w2)));
+
+			// vector4 addition always yields w = 1, which the scalar path relies on
+			return vector4(out[0], out[1], out[2], 1);
+		};
+
+		return vertex_data
+		{
+			lerp(data[0].pos, data[1].pos, data[2].pos),
+			lerp(data[0].fragment, data[1].fragment, data[2].fragment),
+			lerp(data[0].normal, data[1].normal, data[2].normal),
+			lerp(data[0].color, data[1].color, data[2].color),
+			data[0].uv * b0 + data[1].uv * b1 + data[2].uv * b2
+		};
+	}
+
+	void rasterizer::fill_span_sse(const int y, const int x1, const int x2, const vector4& face_normal, const vertex_data* data,
+	                               fragment_batch& batch)
+	{
+		const float fy = static_cast<float>(y);
+		const vector4& p0 = data[0].pos;
+		const vector4& p1 = data[1].pos;
+		const vector4& p2 = data[2].pos;
+
+		// Terms of get_barycentric() which are constant along the scanline, keeping its order of operations
+		const __m128 a1 = _mm_set1_ps(p1.y() - p2.y());
+		const __m128 c1 = _mm_set1_ps((p2.x() - p1.x()) * (fy - p2.y()));
+		const __m128 a2 = _mm_set1_ps(p2.y() - p0.y());
+		const __m128 c2 = _mm_set1_ps((p0.x() - p2.x()) * (fy - p2.y()));
+		const __m128 lower = _mm_set1_ps((p1.y() - p2.y()) * (p0.x() - p2.x()) + (p2.x() - p1.x()) * (p0.y() - p2.y()));
+		const __m128 origin = _mm_set1_ps(p2.x());
+
+		const __m128 z0 = _mm_set1_ps(p0.z());
+		const __m128 z1 = _mm_set1_ps(p1.z());
+		const __m128 z2 = _mm_set1_ps(p2.z());
+
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 one = _mm_set1_ps(1);
+		const __m128 ramp = _mm_setr_ps(0, 1, 2, 3);
+
+		float* depth = depth_ + width_ * y;
+		int x = x1;
+
+		for (; x + 4 <= x2; x += 4)
+		{
+			const __m128 dx = _mm_sub_ps(_mm_add_ps(_mm_set1_ps(static_cast<float>(x)), ramp), origin);
+			const __m128 w0 = _mm_div_ps(_mm_add_ps(_mm_mul_ps(a1, dx), c1), lower);
+			const __m128 w1 = _mm_div_ps(_mm_add_ps(_mm_mul_ps(a2, dx), c2), lower);
+			const __m128 w2 = _mm_sub_ps(one, _mm_add_ps(w0, w1));
+
+			// Pixels are covered unless a weight is negative (NaN counts as covered, like the scalar test)
+			__m128 mask = _mm_and_ps(_mm_and_ps(_mm_cmpnlt_ps(w0, zero), _mm_cmpnlt_ps(w1, zero)), _mm_cmpnlt_ps(w2, zero));
+			const int covered = _mm_movemask_ps(mask);
+			if (covered == 0)
+				continue;
+
+			// The shading pass of the depth pre-pass skips the depth test, and only shades the pixels its face won in the depth pass
+			int bits = covered;
+
+			if (batch.pass != pass_visible)
+			{
+				batch.tested += count_lanes(covered);
+
+				// Depth test all four pixels, and only write the depth of those which pass
+				const __m128 z = _mm_add_ps(_mm_add_ps(_mm_mul_ps(z0, w0), _mm_mul_ps(z1, w1)), _mm_mul_ps(z2, w2));
+				const __m128 old_z = _mm_loadu_ps(depth + x);
+				mask = _mm_and_ps(mask, _mm_cmplt_ps(z, old_z));
+
+				bits = _mm_movemask_ps(mask);
+				batch.occluded += count_lanes(covered & ~bits);
+
+				if (bits == 0)
+					continue;
+
+				_mm_storeu_ps(depth + x, _mm_or_ps(_mm_and_ps(mask, z), _mm_andnot_ps(mask, old_z)));
+				touch_blocks(x, x + 3, y);
+
+				if (batch.pass == pass_depth)
+				{
+					for (int i = 0; i < 4; i++)
+					{
+						if (bits & (1 << i))
+							visibility_[x + i + width_ * y] = batch.face;
+					}
+
+					continue;
+				}
+			}
+
+			float weights[12];
+			_mm_storeu_ps(weights, w0);
+			_mm_storeu_ps(weights + 4, w1);
+			_mm_storeu_ps(weights + 8, w2);
+
+			shade_lanes(x, y, bits, 4, weights, data, batch);
+		}
+
+		// Fill the remaining pixels one at a time
+		fill_span(y, x, x2, face_normal, data, batch);
+	}
+
+	NO_INLINE
+	void rasterizer::shade_lanes(const int x, const int y, const int bits, const int lanes, const float* weights, const vertex_data* data,
+	                             fragment_batch& batch)
+	{
+		for (int i = 0; i < lanes; i++)
+		{
+			if ((bits & (1 << i)) == 0)
+				continue;
+
+			if (batch.pass == pass_visible && !take_visible(x + i, y, batch.face))
+				continue;
+
+			write_fragment(x + i, y, interpolate_fragment_sse(weights[i], weights[lanes + i], weights[lanes * 2 + i], data), batch);
+		}
+	}
+
+	AVX2_TARGET
+	void rasterizer::fill_span_avx2(const int y, const int x1, const int x2, const vector4& face_normal, const vertex_data* data,
+	                                fragment_batch& batch)
+	{
+		const float fy = static_cast<float>(y);
+		const vector4& p0 = data[0].pos;
+		const vector4& p1 = data[1].pos;
+		const vector4& p2 = data[2].pos;
+
+		// Terms of get_barycentric() which are constant along the scanline, keeping its order of operations
+		const __m256 a1 = _mm256_set1_ps(p1.y() - p2.y());
+		const __m256 c1 = _mm256_set1_ps((p2.x() - p1.x()) * (fy - p2.y()));
+		const __m256 a2 = _mm256_set1_ps(p2.y() - p0.y());
+		const __m256 c2 = _mm256_set1_ps((p0.x() - p2.x()) * (fy - p2.y()));
+		const __m256 lower = _mm256_set1_ps((p1.y() - p2.y()) * (p0.x() - p2.x()) + (p2.x() - p1.x()) * (p0.y() - p2.y()));
+		const __m256 origin = _mm256_set1_ps(p2.x());
+
+		const __m256 z0 = _mm256_set1_ps(p0.z());
+		const __m256 z1 = _mm256_set1_ps(p1.z());
+		const __m256 z2 = _mm256_set1_ps(p2.z());
+
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256 one = _mm256_set1_ps(1);
+		const __m256 ramp = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+
+		float* depth = depth_ + width_ * y;
+		int x = x1;
+
+		for (; x + 8 <= x2; x += 8)
+		{
+			const __m256 dx = _mm256_sub_ps(_mm256_add_ps(_mm256_set1_ps(static_cast<float>(x)), ramp), origin);
+			const __m256 w0 = _mm256_div_ps(_mm256_add_ps(_mm256_mul_ps(a1, dx), c1), lower);
+			const __m256 w1 = _mm256_div_ps(_mm256_add_ps(_mm256_mul_ps(a2, dx), c2), lower);
+			const __m256 w2 = _mm256_sub_ps(one, _mm256_add_ps(w0, w1));
+
+			// Pixels are covered unless a weight is negative (NaN counts as covered, like the scalar test)
+			__m256 mask = _mm256_and_ps(_mm256_and_ps(
+				_mm256_cmp_ps(w0, zero, _CMP_NLT_UQ),
+				_mm256_cmp_ps(w1, zero, _CMP_NLT_UQ)),
+				_mm256_cmp_ps(w2, zero, _CMP_NLT_UQ));
+
+			const int covered = _mm256_movemask_ps(mask);
+			if (covered == 0)
+				continue;
+
+			// The shading pass of the depth pre-pass skips the depth test, and only shades the pixels its face won in the depth pass
+			int bits = covered;
+
+			if (batch.pass != pass_visible)
+			{
+				batch.tested += count_lanes(covered);
+
+				// Depth test all eight pixels, and only write the depth of those which pass
+				const __m256 z = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(z0, w0), _mm256_mul_ps(z1, w1)), _mm256_mul_ps(z2, w2));
+				const __m256 old_z = _mm256_loadu_ps(depth + x);
+				mask = _mm256_and_ps(mask, _mm256_cmp_ps(z, old_z, _CMP_LT_OQ));
+
+				bits = _mm256_movemask_ps(mask);
+				batch.occluded += count_lanes(covered & ~bits);
+
+				if (bits == 0)
+					continue;
+
+				_mm256_storeu_ps(depth + x, _mm256_blendv_ps(old_z, z, mask));
+				touch_blocks(x, x + 7, y);
+
+				if (batch.pass == pass_depth)
+				{
+					for (int i = 0; i < 8; i++)
+					{
+						if (bits & (1 << i))
+							visibility_[x + i + width_ * y] = batch.face;
+					}
+
+					continue;
+				}
+			}
+
+			float weights[24];
+			_mm256_storeu_ps(weights, w0);
+			_mm256_storeu_ps(weights + 8, w1);
+			_mm256_storeu_ps(weights + 16, w2);
+
+			// The shading code is not VEX-encoded, so clear the upper halves to avoid AVX-SSE transition stalls
+			_mm256_zeroupper();
+
+			shade_lanes(x, y, bits, 8, weights, data, batch);
+		}
+
+		// Fill the remaining pixels one at a time
+		fill_span(y, x, x2, face_normal, data, batch);
+	}
+}
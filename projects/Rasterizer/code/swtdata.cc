@@ -2,26 +2,224 @@
 #include "color.h"
 
 #include <stb_image.h>
-#include <cstring>
+#include <cmath>
+#include <algorithm>
 
 namespace efiilj
 {
+	namespace
+	{
+		/**
+		 * \brief Packs a pixel of 1 (grey), 2 (grey and alpha), 3 (RGB) or 4 (RGBA) channels into an RGBA value, with red in the lowest byte.
+		 */
+		unsigned pack_pixel(const unsigned char* pixel, const int channels)
+		{
+			switch (channels)
+			{
+			case 1:
+				return pixel[0] | pixel[0] << 8 | pixel[0] << 16 | 0xFFu << 24;
+			case 2:
+				return pixel[0] | pixel[0] << 8 | pixel[0] << 16 | static_cast<unsigned>(pixel[1]) << 24;
+			case 3:
+				return pixel[0] | pixel[1] << 8 | pixel[2] << 16 | 0xFFu << 24;
+			default:
+				return pixel[0] | pixel[1] << 8 | pixel[2] << 16 | static_cast<unsigned>(pixel[3]) << 24;
+			}
+		}
+
+		/**
+		 * \brief Averages four RGBA values, rounding each channel to the nearest integer.
+		 */
+		unsigned average_texels(const unsigned a, const unsigned b, const unsigned c, const unsigned d)
+		{
+			unsigned result = 0;
+
+			for (int shift = 0; shift < 32; shift += 8)
+			{
+				const unsigned sum = (a >> shift & 0xFF) + (b >> shift & 0xFF) + (c >> shift & 0xFF) + (d >> shift & 0xFF);
+				result |= ((sum + 2) >> 2) << shift;
+			}
+
+			return result;
+		}
+
+		/**
+		 * \brief Blends two RGBA values, two channels at a time.
+		 * \param a The first value
+		 * \param b The second value
+		 * \param t The weight of the second value, from 0 to 256
+		 * \return The blended value
+		 */
+		unsigned lerp_texels(const unsigned a, const unsigned b, const unsigned t)
+		{
+			const unsigned red_blue = (((a & 0x00FF00FF) * (256 - t) + (b & 0x00FF00FF) * t) >> 8) & 0x00FF00FF;
+			const unsigned green_alpha = (((a >> 8) & 0x00FF00FF) * (256 - t) + ((b >> 8) & 0x00FF00FF) * t) & 0xFF00FF00;
+			return red_blue | green_alpha;
+		}
+
+		/**
+		 * \brief Converts a fraction in [0, 1) to a blending weight for lerp_texels().
+		 */
+		unsigned to_weight(const float fraction)
+		{
+			return std::min(static_cast<unsigned>(fraction * 256.0f), 255u);
+		}
+
+		vector4 to_color(const unsigned texel)
+		{
+			return
+			{
+				static_cast<float>(texel & 0xFF),
+				static_cast<float>(texel >> 8 & 0xFF),
+				static_cast<float>(texel >> 16 & 0xFF),
+				static_cast<float>(texel >> 24)
+			};
+		}
+
+		bool is_power_of_two(const int value)
+		{
+			return value > 0 && (value & (value - 1)) == 0;
+		}
+	}
+
 	texture_data::texture_data(const char* path, const int comp)
 	{
-		texture_ = stbi_load(path, &width_, &height_, &bits_per_pixel_, comp);
+		unsigned char* pixels = stbi_load(path, &width_, &height_, &bits_per_pixel_, comp);
+
+		if (pixels == nullptr)
+		{
+			width_ = height_ = bits_per_pixel_ = 0;
+			return;
+		}
+
+		power_of_two_ = is_power_of_two(width_) && is_power_of_two(height_);
+		build_levels(pixels, comp != 0 ? comp : bits_per_pixel_);
+
+		stbi_image_free(pixels);
+	}
+
+	void texture_data::build_levels(const unsigned char* pixels, const int channels)
+	{
+		// Lay out the levels, each padded to whole tiles
+		size_t size = 0;
+		int width = width_, height = height_;
+
+		while (true)
+		{
+			const unsigned tiles_x = (width + 3) / 4;
+			const unsigned tiles_y = (height + 3) / 4;
+
+			levels_.push_back(mip_level { width, height, tiles_x, size });
+			size += static_cast<size_t>(tiles_x) * tiles_y * 16;
+
+			if (width == 1 && height == 1)
+				break;
+
+			width = std::max(width / 2, 1);
+			height = std::max(height / 2, 1);
+		}
+
+		texels_.assign(size, 0);
+
+		const mip_level& base = levels_[0];
+
+		for (int y = 0; y < height_; y++)
+			for (int x = 0; x < width_; x++)
+				texels_[get_address(base, x, y)] = pack_pixel(&pixels[(static_cast<size_t>(y) * width_ + x) * channels], channels);
+
+		for (size_t i = 1; i < levels_.size(); i++)
+		{
+			const mip_level& src = levels_[i - 1];
+			const mip_level& dst = levels_[i];
+
+			for (int y = 0; y < dst.height; y++)
+			{
+				// Odd sizes drop the last row or column, and levels one texel wide repeat the same one
+				const unsigned y0 = std::min(y * 2, src.height - 1);
+				const unsigned y1 = std::min(y * 2 + 1, src.height - 1);
+
+				for (int x = 0; x < dst.width; x++)
+				{
+					const unsigned x0 = std::min(x * 2, src.width - 1);
+					const unsigned x1 = std::min(x * 2 + 1, src.width - 1);
+
+					texels_[get_address(dst, x, y)] = average_texels(
+						texels_[get_address(src, x0, y0)], texels_[get_address(src, x1, y0)],
+						texels_[get_address(src, x0, y1)], texels_[get_address(src, x1, y1)]);
+				}
+			}
+		}
 	}
 
-	texture_data::~texture_data()
+	unsigned texture_data::sample_level(const vector2& uv, const int level) const
 	{
-		stbi_image_free(texture_);
+		const mip_level& mip = levels_[level];
+
+		// Texel centers lie at half-integer coordinates
+		const float x = uv.x() * static_cast<float>(mip.width) - 0.5f;
+		const float y = uv.y() * static_cast<float>(mip.height) - 0.5f;
+		const float floor_x = std::floor(x);
+		const float floor_y = std::floor(y);
+
+		const int x0 = static_cast<int>(floor_x);
+		const int y0 = static_cast<int>(floor_y);
+
+		const unsigned top = lerp_texels(get_texel(level, x0, y0), get_texel(level, x0 + 1, y0), to_weight(x - floor_x));
+		const unsigned bottom = lerp_texels(get_texel(level, x0, y0 + 1), get_texel(level, x0 + 1, y0 + 1), to_weight(x - floor_x));
+
+		return lerp_texels(top, bottom, to_weight(y - floor_y));
 	}
 
 	vector4 texture_data::get_pixel(const vector2& uv) const
-	{	
-		const int tex_x = static_cast<int>(static_cast<float>(width_)  * uv.x()) % width_;
-		const int tex_y = static_cast<int>(static_cast<float>(height_)* uv.y()) % height_;
-		const unsigned char* pos = &texture_[(tex_x + width_ * tex_y) * bits_per_pixel_];
+	{
+		if (levels_.empty())
+			return vector4(0, 0, 0, 0xFF);
+
+		const int tex_x = static_cast<int>(static_cast<float>(width_) * uv.x());
+		const int tex_y = static_cast<int>(static_cast<float>(height_) * uv.y());
+
+		return to_color(get_texel(0, tex_x, tex_y));
+	}
+
+	float texture_data::get_lod(const vector2& uv_dx, const vector2& uv_dy) const
+	{
+		// Scale the derivatives to texels of the full-size texture, and use the longer axis of the footprint
+		const float dx_u = uv_dx.x() * static_cast<float>(width_);
+		const float dx_v = uv_dx.y() * static_cast<float>(height_);
+		const float dy_u = uv_dy.x() * static_cast<float>(width_);
+		const float dy_v = uv_dy.y() * static_cast<float>(height_);
+
+		const float footprint = std::max(dx_u * dx_u + dx_v * dx_v, dy_u * dy_u + dy_v * dy_v);
 
-		return {static_cast<float>(pos[0]), static_cast<float>(pos[1]), static_cast<float>(pos[2]), static_cast<float>(bits_per_pixel_ == 4 ? pos[3] : 0xFF) };
+		// Half the logarithm of the squared length, saving the square root
+		return footprint > 0 ? 0.5f * std::log2(footprint) : 0.0f;
+	}
+
+	unsigned texture_data::sample_packed(const vector2& uv, const vector2& uv_dx, const vector2& uv_dy) const
+	{
+		if (levels_.empty())
+			return 0xFF000000;
+
+		if (filter_ == filter_nearest)
+			return get_texel(0, static_cast<int>(static_cast<float>(width_) * uv.x()), static_cast<int>(static_cast<float>(height_) * uv.y()));
+
+		const float max_lod = static_cast<float>(levels_.size() - 1);
+		const float lod = std::min(std::max(get_lod(uv_dx, uv_dy), 0.0f), max_lod);
+
+		if (filter_ == filter_bilinear)
+			return sample_level(uv, static_cast<int>(lod + 0.5f));
+
+		const int level = static_cast<int>(lod);
+		const unsigned weight = to_weight(lod - static_cast<float>(level));
+
+		if (weight == 0)
+			return sample_level(uv, level);
+
+		return lerp_texels(sample_level(uv, level), sample_level(uv, level + 1), weight);
+	}
+
+	vector4 texture_data::sample(const vector2& uv, const vector2& uv_dx, const vector2& uv_dy) const
+	{
+		return to_color(sample_packed(uv, uv_dx, uv_dy));
 	}
 }
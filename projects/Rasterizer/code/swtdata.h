@@ -3,19 +3,95 @@
 #include "matrix4.h"
 #include "color.h"
 
+#include <vector>
+
 namespace efiilj
 {
+	/**
+	 * \brief Filtering modes used when sampling a texture with UV derivatives.
+	 */
+	enum texture_filter
+	{
+		/**
+		 * \brief Reads the closest texel of the full-size texture.
+		 */
+		filter_nearest,
+		/**
+		 * \brief Blends the four closest texels of the mip level closest to the footprint of the fragment.
+		 */
+		filter_bilinear,
+		/**
+		 * \brief Blends bilinear samples of the two mip levels around the footprint of the fragment.
+		 */
+		filter_trilinear
+	};
 
 	/**
 	 * \brief A class to load and represent a texture in byte format.
+	 * The texture is expanded to RGBA and stored along with a chain of mip levels, each half the size of the previous one.
+	 * Texels are stored in 4x4 tiles of 64 bytes, ordered along a Z-curve within each tile,
+	 * so that the texels read by neighbouring fragments and by a bilinear footprint are likely to share a cache line.
 	 */
 	class texture_data
 	{
 	private:
-		unsigned char* texture_;
+		/**
+		 * \brief The size of a mip level, and the position of its first tile in the texel array.
+		 */
+		struct mip_level
+		{
+			int width, height;
+			unsigned tiles_x;
+			size_t offset;
+		};
+
+		std::vector<unsigned> texels_;
+		std::vector<mip_level> levels_;
 		int width_ {};
 		int height_ {};
 		int bits_per_pixel_ {};
+		bool power_of_two_ {};
+		texture_filter filter_ = filter_trilinear;
+
+		/**
+		 * \brief Allocates the mip chain and fills every level from the one above it, using a 2x2 box filter.
+		 * \param pixels The full-size texture, as rows of channels bytes per pixel
+		 * \param channels The number of channels in the pixel data
+		 */
+		void build_levels(const unsigned char* pixels, int channels);
+
+		/**
+		 * \brief Wraps a texel coordinate so that the texture repeats.
+		 * \param coord The texel coordinate
+		 * \param size The size of the mip level along the axis
+		 * \return The coordinate within [0, size)
+		 */
+		int wrap(const int coord, const int size) const
+		{
+			if (power_of_two_)
+				return coord & (size - 1);
+
+			const int rem = coord % size;
+			return rem < 0 ? rem + size : rem;
+		}
+
+		/**
+		 * \brief Returns the position of a texel in the tiled texel array.
+		 */
+		static size_t get_address(const mip_level& level, const unsigned x, const unsigned y)
+		{
+			const unsigned tile = (y >> 2) * level.tiles_x + (x >> 2);
+			const unsigned morton = (x & 1) | ((y & 1) << 1) | ((x & 2) << 1) | ((y & 2) << 2);
+			return level.offset + tile * 16 + morton;
+		}
+
+		/**
+		 * \brief Blends four neighbouring texels of a mip level.
+		 * \param uv The UV point to sample
+		 * \param level The mip level to sample
+		 * \return The blended texel, as a packed RGBA value
+		 */
+		unsigned sample_level(const vector2& uv, int level) const;
 
 	public:
 		/**
@@ -24,11 +100,9 @@ namespace efiilj
 		 * \param comp Set channel count to a specific value
 		 */
 		explicit texture_data(const char* path, int comp = 0);
-		~texture_data();
 
-		//TODO: Implement maybe
-		texture_data(texture_data& other);
-		texture_data(texture_data&& other); 
+		texture_data(const texture_data& other) = default;
+		texture_data(texture_data&& other) = default;
 
 		/**
 		 * \brief Get the width of the texture.
@@ -41,18 +115,43 @@ namespace efiilj
 		 * \return The texture height in pixels
 		 */
 		int height() const { return height_; }
-		
+
 		/**
 		 * \brief Gets the number of bits per pixel.
 		 * \return The BPP-value of the texture
 		 */
 		int bits_per_pixel() const { return bits_per_pixel_; }
-		
+
 		/**
-		 * \brief Returns a pointer to the texture data array.
-		 * \return A pointer to the first color channel in the texture
+		 * \brief Gets the number of mip levels, including the full-size texture.
+		 * \return The length of the mip chain, or 0 if the texture failed to load
 		 */
-		unsigned char* texture() const { return texture_; }
+		int levels() const { return static_cast<int>(levels_.size()); }
+
+		/**
+		 * \brief Gets the filtering mode used by sample().
+		 * \return The current filtering mode
+		 */
+		texture_filter filter() const { return filter_; }
+
+		/**
+		 * \brief Sets the filtering mode used by sample().
+		 * \param filter The new filtering mode
+		 */
+		void filter(const texture_filter filter) { filter_ = filter; }
+
+		/**
+		 * \brief Reads a single texel of a mip level, wrapping the coordinates.
+		 * \param level The mip level to read
+		 * \param x The texel column
+		 * \param y The texel row
+		 * \return The texel as a packed RGBA value, with red in the lowest byte
+		 */
+		unsigned get_texel(int level, int x, int y) const
+		{
+			const mip_level& mip = levels_[level];
+			return texels_[get_address(mip, wrap(x, mip.width), wrap(y, mip.height))];
+		}
 
 		/**
 		 * \brief Samples a specific point on the texture and returns the color.
@@ -60,6 +159,31 @@ namespace efiilj
 		 * \return The color of the point, or black upon error
 		 */
 		vector4 get_pixel(const vector2& uv) const;
-		
+
+		/**
+		 * \brief Selects the mip level matching the footprint of a fragment on the texture.
+		 * \param uv_dx The change in UV coordinates between horizontally adjacent fragments
+		 * \param uv_dy The change in UV coordinates between vertically adjacent fragments
+		 * \return The level of detail, where 0 is the full-size texture and each step halves the size
+		 */
+		float get_lod(const vector2& uv_dx, const vector2& uv_dy) const;
+
+		/**
+		 * \brief Samples a point on the texture using the filtering mode of the texture.
+		 * \param uv The UV point to sample
+		 * \param uv_dx The change in UV coordinates between horizontally adjacent fragments
+		 * \param uv_dy The change in UV coordinates between vertically adjacent fragments
+		 * \return The filtered color of the point, or black upon error
+		 */
+		vector4 sample(const vector2& uv, const vector2& uv_dx, const vector2& uv_dy) const;
+
+		/**
+		 * \brief Samples a point on the texture like sample(), without converting the result to floating-point.
+		 * \param uv The UV point to sample
+		 * \param uv_dx The change in UV coordinates between horizontally adjacent fragments
+		 * \param uv_dy The change in UV coordinates between vertically adjacent fragments
+		 * \return The filtered color as a packed RGBA value with red in the lowest byte, or black upon error
+		 */
+		unsigned sample_packed(const vector2& uv, const vector2& uv_dx, const vector2& uv_dy) const;
 	};
 }
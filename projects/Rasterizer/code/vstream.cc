@@ -0,0 +1,178 @@
+#include "vstream.h"
+
+#include <cstdint>
+#include <emmintrin.h>
+
+namespace efiilj
+{
+	vertex_stream::vertex_stream()
+	: base_(nullptr), count_(0), stride_(0)
+	{ }
+
+	vertex_stream::vertex_stream(const vertex* vertices, const unsigned count)
+	: base_(nullptr), count_(0), stride_(0)
+	{
+		allocate(count);
+
+		for (unsigned i = 0; i < count; i++)
+			store(i, vertices[i]);
+	}
+
+	vertex_stream::vertex_stream(const packed_vertex* vertices, const unsigned count, const bounding_box& bounds)
+	: base_(nullptr), count_(0), stride_(0)
+	{
+		allocate(count);
+
+		for (unsigned i = 0; i < count; i++)
+			store(i, vertices[i].unpack(bounds));
+	}
+
+	vertex_stream::vertex_stream(vertex_stream&& other) noexcept
+	: storage_(std::move(other.storage_)), base_(other.base_), count_(other.count_), stride_(other.stride_)
+	{
+		other.base_ = nullptr;
+		other.count_ = other.stride_ = 0;
+	}
+
+	vertex_stream& vertex_stream::operator = (vertex_stream&& other) noexcept
+	{
+		if (this != &other)
+		{
+			// Moving a vector keeps its buffer, so the aligned base pointer stays valid
+			storage_ = std::move(other.storage_);
+			base_ = other.base_;
+			count_ = other.count_;
+			stride_ = other.stride_;
+
+			other.base_ = nullptr;
+			other.count_ = other.stride_ = 0;
+		}
+
+		return *this;
+	}
+
+	void vertex_stream::allocate(const unsigned count)
+	{
+		count_ = count;
+		stride_ = (count + 3) & ~3u;
+
+		if (count == 0)
+			return;
+
+		// Pad each array to a multiple of four floats, and over-allocate so the first array can start on a 16-byte boundary
+		storage_.resize(static_cast<size_t>(stride_) * stream_component_count + 3);
+		const uintptr_t address = reinterpret_cast<uintptr_t>(storage_.data());
+		base_ = storage_.data() + ((16 - (address & 15)) & 15) / sizeof(float);
+	}
+
+	void vertex_stream::store(const unsigned position, const vertex& vert)
+	{
+		const float values[stream_component_count] =
+		{
+			vert.xyzw.x(), vert.xyzw.y(), vert.xyzw.z(),
+			vert.normal.x(), vert.normal.y(), vert.normal.z(),
+			vert.rgba.x(), vert.rgba.y(), vert.rgba.z(), vert.rgba.w(),
+			vert.uv.x(), vert.uv.y()
+		};
+
+		for (unsigned i = 0; i < stream_component_count; i++)
+			base_[stride_ * i + position] = values[i];
+	}
+
+	vertex vertex_stream::get_vertex(const unsigned position) const
+	{
+		vertex vert;
+
+		vert.xyzw = get_position(position);
+		vert.normal = vector4(get(stream_normal_x)[position], get(stream_normal_y)[position], get(stream_normal_z)[position], 1);
+		vert.rgba = vector4(get(stream_color_r)[position], get(stream_color_g)[position], get(stream_color_b)[position], get(stream_color_a)[position]);
+		vert.uv = vector2(get(stream_uv_u)[position], get(stream_uv_v)[position]);
+
+		return vert;
+	}
+
+	namespace
+	{
+		/**
+		 * \brief Reads the w components of vectors from an array.
+		 */
+		struct w_array
+		{
+			const float* w;
+
+			__m128 load(const unsigned i) const { return _mm_loadu_ps(w + i); }
+			float at(const unsigned i) const { return w[i]; }
+		};
+
+		/**
+		 * \brief Supplies the same w component for every vector.
+		 */
+		struct w_constant
+		{
+			float w;
+
+			__m128 load(unsigned) const { return _mm_set1_ps(w); }
+			float at(unsigned) const { return w; }
+		};
+
+		template <typename W>
+		void transform_vectors(const matrix4& mat, const float* const in[3], const W w_in, const unsigned count, float* const out[4])
+		{
+			float rows[4][4];
+			for (int r = 0; r < 4; r++)
+			{
+				const vector4 row = mat.row(r);
+				rows[r][0] = row.x();
+				rows[r][1] = row.y();
+				rows[r][2] = row.z();
+				rows[r][3] = row.w();
+			}
+
+			__m128 lanes[4][4];
+			for (int r = 0; r < 4; r++)
+				for (int c = 0; c < 4; c++)
+					lanes[r][c] = _mm_set1_ps(rows[r][c]);
+
+			unsigned i = 0;
+
+			// Four vertices per iteration, one per lane, keeping the order of operations of vector4::dot4
+			for (; i + 4 <= count; i += 4)
+			{
+				const __m128 x = _mm_loadu_ps(in[0] + i);
+				const __m128 y = _mm_loadu_ps(in[1] + i);
+				const __m128 z = _mm_loadu_ps(in[2] + i);
+				const __m128 w = w_in.load(i);
+
+				for (int r = 0; r < 4; r++)
+				{
+					const __m128 dot = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+						_mm_mul_ps(x, lanes[r][0]),
+						_mm_mul_ps(y, lanes[r][1])),
+						_mm_mul_ps(z, lanes[r][2])),
+						_mm_mul_ps(w, lanes[r][3]));
+
+					_mm_storeu_ps(out[r] + i, dot);
+				}
+			}
+
+			// Transform the remaining vertices one at a time
+			for (; i < count; i++)
+			{
+				const float x = in[0][i], y = in[1][i], z = in[2][i], w = w_in.at(i);
+
+				for (int r = 0; r < 4; r++)
+					out[r][i] = x * rows[r][0] + y * rows[r][1] + z * rows[r][2] + w * rows[r][3];
+			}
+		}
+	}
+
+	void vertex_stream::transform(const matrix4& mat, const float* const in[4], const unsigned count, float* const out[4])
+	{
+		transform_vectors(mat, in, w_array { in[3] }, count, out);
+	}
+
+	void vertex_stream::transform(const matrix4& mat, const float* const in[3], const float w, const unsigned count, float* const out[4])
+	{
+		transform_vectors(mat, in, w_constant { w }, count, out);
+	}
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include "vertex.h"
+#include "packed.h"
+
+#include <vector>
+
+namespace efiilj
+{
+	/**
+	 * \brief The components stored in a vertex stream, each in a separate array.
+	 * The w components of positions and normals are always 1, and are not stored.
+	 */
+	enum stream_component
+	{
+		stream_pos_x,
+		stream_pos_y,
+		stream_pos_z,
+		stream_normal_x,
+		stream_normal_y,
+		stream_normal_z,
+		stream_color_r,
+		stream_color_g,
+		stream_color_b,
+		stream_color_a,
+		stream_uv_u,
+		stream_uv_v,
+		stream_component_count
+	};
+
+	/**
+	 * \brief A vertex buffer stored as a structure of arrays, with one 16-byte aligned array per vertex component.
+	 * Consecutive vertices of a component are adjacent in memory, so a vertex shader can transform several vertices at once
+	 * with SIMD instructions, one vertex per lane.
+	 */
+	class vertex_stream
+	{
+	private:
+		std::vector<float> storage_;
+		float* base_;
+		unsigned count_, stride_;
+
+		/**
+		 * \brief Allocates the aligned component arrays for a number of vertices.
+		 * \param count The number of vertices in the stream
+		 */
+		void allocate(unsigned count);
+
+		/**
+		 * \brief Writes the components of a vertex into the stream.
+		 * \param position The position of the vertex in the stream
+		 * \param vert The vertex to store
+		 */
+		void store(unsigned position, const vertex& vert);
+
+	public:
+		/**
+		 * \brief Creates an empty vertex stream.
+		 */
+		vertex_stream();
+
+		/**
+		 * \brief Creates a vertex stream from a list of vertices, such as the vertex buffer of an object loader.
+		 * \param vertices List of vertices to copy into the stream
+		 * \param count Size of the vertex list
+		 */
+		vertex_stream(const vertex* vertices, unsigned count);
+
+		/**
+		 * \brief Creates a vertex stream by decoding a list of packed vertices.
+		 * \param vertices List of packed vertices to decode into the stream
+		 * \param count Size of the vertex list
+		 * \param bounds The bounding box the vertices were packed with
+		 */
+		vertex_stream(const packed_vertex* vertices, unsigned count, const bounding_box& bounds);
+
+		vertex_stream(vertex_stream&& other) noexcept;
+		vertex_stream& operator = (vertex_stream&& other) noexcept;
+
+		vertex_stream(const vertex_stream&) = delete;
+		vertex_stream& operator = (const vertex_stream&) = delete;
+
+		/**
+		 * \brief Gets the number of vertices in the stream.
+		 * \return The vertex count of the stream
+		 */
+		unsigned size() const { return count_; }
+
+		/**
+		 * \brief Returns the array holding a component of every vertex in the stream.
+		 * \param component The vertex component to return
+		 * \return A 16-byte aligned array of size() floats
+		 */
+		const float* get(const stream_component component) const { return base_ + stride_ * component; }
+
+		/**
+		 * \brief Copies a vertex out of the stream.
+		 * \param position The position of the vertex in the stream
+		 * \return The vertex at the given position
+		 */
+		vertex get_vertex(unsigned position) const;
+
+		/**
+		 * \brief Reads the position of a vertex in the stream.
+		 * \param position The position of the vertex in the stream
+		 * \return The object-space position of the vertex, with w = 1
+		 */
+		vector4 get_position(const unsigned position) const
+		{
+			return vector4(get(stream_pos_x)[position], get(stream_pos_y)[position], get(stream_pos_z)[position], 1);
+		}
+
+		/**
+		 * \brief Transforms a range of four-component vectors, stored as arrays of components, by a matrix.
+		 * The arithmetic matches matrix4 * vector4, so the results are identical to transforming one vector at a time.
+		 * \param mat The matrix to transform by
+		 * \param in Arrays holding the x, y, z and w components of the vectors
+		 * \param count The number of vectors to transform
+		 * \param out Arrays receiving the x, y, z and w components of the transformed vectors, which may not overlap the input
+		 */
+		static void transform(const matrix4& mat, const float* const in[4], unsigned count, float* const out[4]);
+
+		/**
+		 * \brief Transforms a range of vectors like transform(), with the same w component for every vector,
+		 * such as the positions and normals of the stream, whose w is not stored.
+		 * \param mat The matrix to transform by
+		 * \param in Arrays holding the x, y and z components of the vectors
+		 * \param w The w component of every vector
+		 * \param count The number of vectors to transform
+		 * \param out Arrays receiving the x, y, z and w components of the transformed vectors, which may not overlap the input
+		 */
+		static void transform(const matrix4& mat, const float* const in[3], float w, unsigned count, float* const out[4]);
+	};
+}
@@ -0,0 +1,83 @@
+#include "workers.h"
+
+#include <algorithm>
+
+namespace efiilj
+{
+	worker_pool::worker_pool(unsigned thread_count)
+		: next_job_(0), job_count_(0), busy_(0), generation_(0), exit_(false)
+	{
+		if (thread_count == 0)
+			thread_count = std::max(std::thread::hardware_concurrency(), 1u);
+
+		// The calling thread participates in every batch, so spawn one less
+		for (unsigned i = 1; i < thread_count; i++)
+			threads_.emplace_back(&worker_pool::work, this);
+	}
+
+	worker_pool::~worker_pool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			exit_ = true;
+		}
+
+		wake_.notify_all();
+
+		for (auto& thread : threads_)
+			thread.join();
+	}
+
+	void worker_pool::work()
+	{
+		unsigned generation = 0;
+
+		while (true)
+		{
+			{
+				std::unique_lock<std::mutex> lock(mutex_);
+				wake_.wait(lock, [&] { return exit_ || generation_ != generation; });
+
+				if (exit_)
+					return;
+
+				generation = generation_;
+			}
+
+			drain();
+
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (--busy_ == 0)
+				done_.notify_one();
+		}
+	}
+
+	void worker_pool::drain()
+	{
+		unsigned index;
+		while ((index = next_job_++) < job_count_)
+			job_(index);
+	}
+
+	void worker_pool::run(const unsigned job_count, const std::function<void(unsigned)>& job)
+	{
+		if (job_count == 0)
+			return;
+
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			job_ = job;
+			job_count_ = job_count;
+			next_job_ = 0;
+			busy_ = static_cast<unsigned>(threads_.size());
+			generation_++;
+		}
+
+		wake_.notify_all();
+		drain();
+
+		// Wait for the workers to finish the jobs they have already claimed
+		std::unique_lock<std::mutex> lock(mutex_);
+		done_.wait(lock, [this] { return busy_ == 0; });
+	}
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <condition_variable>
+
+namespace efiilj
+{
+	/**
+	 * \brief A persistent pool of worker threads, used to run a batch of indexed jobs in parallel.
+	 */
+	class worker_pool
+	{
+	private:
+		std::vector<std::thread> threads_;
+		std::mutex mutex_;
+		std::condition_variable wake_, done_;
+
+		std::function<void(unsigned)> job_;
+		std::atomic<unsigned> next_job_;
+		unsigned job_count_, busy_, generation_;
+		bool exit_;
+
+		/**
+		 * \brief Main loop of a worker thread, which sleeps until a new batch is started.
+		 */
+		void work();
+
+		/**
+		 * \brief Claims and runs jobs from the current batch until none remain.
+		 */
+		void drain();
+
+	public:
+		/**
+		 * \brief Creates a new worker pool instance.
+		 * \param thread_count The total number of threads working on a batch, including the calling thread (0 = hardware concurrency)
+		 */
+		explicit worker_pool(unsigned thread_count = 0);
+		~worker_pool();
+
+		worker_pool(const worker_pool&) = delete;
+		worker_pool& operator = (const worker_pool&) = delete;
+
+		/**
+		 * \brief Gets the total number of threads working on a batch, including the calling thread.
+		 * \return The thread count of the pool
+		 */
+		unsigned size() const { return static_cast<unsigned>(threads_.size()) + 1; }
+
+		/**
+		 * \brief Runs a job once for every index in [0, job_count), and blocks until all jobs have finished.
+		 * Jobs are claimed in ascending order, but may run concurrently and finish in any order.
+		 * \param job_count The number of jobs in the batch
+		 * \param job The function to run for each job index
+		 */
+		void run(unsigned job_count, const std::function<void(unsigned)>& job);
+	};
+}
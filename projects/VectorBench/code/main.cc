@@ -0,0 +1,202 @@
+//------------------------------------------------------------------------------
+// main.cc
+// (C) 2015-2018 Individual contributors, see AUTHORS file
+//------------------------------------------------------------------------------
+#include "config.h"
+#include "matrix4.h"
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+
+/*
+ * Compares the SIMD implementations of the vector4 and matrix4 operators against the scalar implementations they replaced,
+ * which are reproduced below. Every operation is run over the same batch of random inputs with both implementations,
+ * the results are checked to be bit-identical, and the best time of several runs is reported in nanoseconds per operation.
+ *
+ * Usage: VectorBench [iterations]
+ */
+
+namespace
+{
+	using namespace efiilj;
+
+	/// <summary>
+	/// The scalar implementations of the operators, computing one component at a time through the accessors.
+	/// </summary>
+	namespace scalar
+	{
+		vector4 add(const vector4& a, const vector4& b)
+		{
+			vector4 vect;
+			vect.x(a.x() + b.x());
+			vect.y(a.y() + b.y());
+			vect.z(a.z() + b.z());
+			return vect;
+		}
+
+		vector4 mul(const vector4& a, const vector4& b)
+		{
+			vector4 vect;
+			vect.x(a.x() * b.x());
+			vect.y(a.y() * b.y());
+			vect.z(a.z() * b.z());
+			vect.w(a.w() * b.w());
+			return vect;
+		}
+
+		vector4 scale(const vector4& a, const float s)
+		{
+			vector4 vect;
+			vect.x(a.x() * s);
+			vect.y(a.y() * s);
+			vect.z(a.z() * s);
+			vect.w(a.w() * s);
+			return vect;
+		}
+
+		vector4 transform(const matrix4& m, const vector4& v)
+		{
+			vector4 vect;
+			vect.x(v.dot4(m.row(0)));
+			vect.y(v.dot4(m.row(1)));
+			vect.z(v.dot4(m.row(2)));
+			vect.w(v.dot4(m.row(3)));
+			return vect;
+		}
+
+		matrix4 multiply(const matrix4& a, const matrix4& b)
+		{
+			matrix4 mat;
+
+			for (int x = 0; x < 4; x++)
+				for (int y = 0; y < 4; y++)
+					mat(x, y) = vector4::dot4(a.row(y), b.col(x));
+
+			return mat;
+		}
+
+		matrix4 transpose(const matrix4& m)
+		{
+			matrix4 mat;
+
+			for (int x = 0; x < 4; x++)
+				for (int y = 0; y < 4; y++)
+					mat(x, y) = m.at(y, x);
+
+			return mat;
+		}
+	}
+
+	const int batch_size = 1024;
+	const int runs = 5;
+
+	float random_float()
+	{
+		return static_cast<float>(std::rand()) / RAND_MAX * 4.0f - 2.0f;
+	}
+
+	vector4 random_vector()
+	{
+		return vector4(random_float(), random_float(), random_float(), random_float());
+	}
+
+	matrix4 random_matrix()
+	{
+		return matrix4(random_vector(), random_vector(), random_vector(), random_vector());
+	}
+
+	/// <summary>
+	/// Runs an operation over a batch of inputs a number of times, and returns the best time per operation.
+	/// </summary>
+	/// <param name="iterations">The number of times to run the batch in each timed run</param>
+	/// <param name="op">Function which runs the operation for input i, and stores the result</param>
+	/// <returns>The fastest run, in nanoseconds per operation</returns>
+	template <typename F>
+	double time_op(const int iterations, F op)
+	{
+		double best = 0;
+
+		for (int run = 0; run < runs; run++)
+		{
+			const auto start = std::chrono::steady_clock::now();
+
+			for (int it = 0; it < iterations; it++)
+				for (int i = 0; i < batch_size; i++)
+					op(i);
+
+			const double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count()
+				/ (static_cast<double>(iterations) * batch_size);
+
+			if (run == 0 || ns < best)
+				best = ns;
+		}
+
+		return best;
+	}
+
+	void report(const char* name, const double scalar_ns, const double simd_ns, const bool identical)
+	{
+		std::cout << std::left << std::setw(12) << name << std::right
+			<< std::setw(12) << scalar_ns << std::setw(12) << simd_ns
+			<< std::setw(10) << (simd_ns > 0 ? scalar_ns / simd_ns : 0) << "x"
+			<< (identical ? "" : "  results differ!") << "\n";
+	}
+}
+
+int
+main(int argc, const char** argv)
+{
+	const int iterations = argc > 1 ? std::max(std::atoi(argv[1]), 1) : 2000;
+
+	std::srand(1);
+
+	std::vector<vector4> vectors, others, scalar_vectors(batch_size), simd_vectors(batch_size);
+	std::vector<matrix4> matrices, other_matrices, scalar_matrices(batch_size), simd_matrices(batch_size);
+	std::vector<float> scalars;
+
+	for (int i = 0; i < batch_size; i++)
+	{
+		vectors.push_back(random_vector());
+		others.push_back(random_vector());
+		matrices.push_back(random_matrix());
+		other_matrices.push_back(random_matrix());
+		scalars.push_back(random_float());
+	}
+
+	const auto same_vectors = [&]() { return std::memcmp(scalar_vectors.data(), simd_vectors.data(), batch_size * sizeof(vector4)) == 0; };
+	const auto same_matrices = [&]() { return std::memcmp(scalar_matrices.data(), simd_matrices.data(), batch_size * sizeof(matrix4)) == 0; };
+
+	std::cout << std::fixed << std::setprecision(2);
+	std::cout << std::left << std::setw(12) << "op" << std::right << std::setw(12) << "scalar ns" << std::setw(12) << "simd ns" << std::setw(11) << "speedup" << "\n";
+
+	double scalar_ns = time_op(iterations, [&](const int i) { scalar_vectors[i] = scalar::add(vectors[i], others[i]); });
+	double simd_ns = time_op(iterations, [&](const int i) { simd_vectors[i] = vectors[i] + others[i]; });
+	report("vec + vec", scalar_ns, simd_ns, same_vectors());
+
+	scalar_ns = time_op(iterations, [&](const int i) { scalar_vectors[i] = scalar::mul(vectors[i], others[i]); });
+	simd_ns = time_op(iterations, [&](const int i) { simd_vectors[i] = vectors[i] * others[i]; });
+	report("vec * vec", scalar_ns, simd_ns, same_vectors());
+
+	scalar_ns = time_op(iterations, [&](const int i) { scalar_vectors[i] = scalar::scale(vectors[i], scalars[i]); });
+	simd_ns = time_op(iterations, [&](const int i) { simd_vectors[i] = vectors[i] * scalars[i]; });
+	report("vec * float", scalar_ns, simd_ns, same_vectors());
+
+	scalar_ns = time_op(iterations, [&](const int i) { scalar_vectors[i] = scalar::transform(matrices[i], vectors[i]); });
+	simd_ns = time_op(iterations, [&](const int i) { simd_vectors[i] = matrices[i] * vectors[i]; });
+	report("mat * vec", scalar_ns, simd_ns, same_vectors());
+
+	scalar_ns = time_op(iterations, [&](const int i) { scalar_matrices[i] = scalar::multiply(matrices[i], other_matrices[i]); });
+	simd_ns = time_op(iterations, [&](const int i) { simd_matrices[i] = matrices[i] * other_matrices[i]; });
+	report("mat * mat", scalar_ns, simd_ns, same_matrices());
+
+	scalar_ns = time_op(iterations, [&](const int i) { scalar_matrices[i] = scalar::transpose(matrices[i]); });
+	simd_ns = time_op(iterations, [&](const int i) { simd_matrices[i] = matrices[i].transpose(); });
+	report("transpose", scalar_ns, simd_ns, same_matrices());
+
+	return 0;
+}
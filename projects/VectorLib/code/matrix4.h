@@ -15,8 +15,9 @@ namespace efiilj
 
 	/// <summary>
 	/// Class to represent a 4-dimensional matrix.
+	/// Rows are aligned to 16 bytes, and products and transposes are computed a whole row at a time in SIMD registers.
 	/// </summary>
-	class matrix4
+	class alignas(16) matrix4
 	{
 	private:
 		vector4 arr_[4];
@@ -72,10 +73,7 @@ namespace efiilj
 		/// Constructs a copy of the specified matrix.
 		/// </summary>
 		/// <param name="copy">The matrix of which to create a copy</param>
-		matrix4(const matrix4& copy)
-		{
-			*this = copy;
-		}
+		matrix4(const matrix4& copy) = default;
 
 		/// <summary>
 		/// Creates a Matrix4 from the specified row vectors, from top to bottom.
@@ -99,30 +97,7 @@ namespace efiilj
 		/// </summary>
 		/// <param name="other">The matrix which values are to be copied</param>
 		/// <returns>A reference to the current matrix, after modification</returns>
-		matrix4& operator = (const matrix4& other)
-		{
-			(*this)(0, 0) = other.at(0, 0);
-			(*this)(0, 1) = other.at(0, 1);
-			(*this)(0, 2) = other.at(0, 2);
-			(*this)(0, 3) = other.at(0, 3);
-
-			(*this)(1, 0) = other.at(1, 0);
-			(*this)(1, 1) = other.at(1, 1);
-			(*this)(1, 2) = other.at(1, 2);
-			(*this)(1, 3) = other.at(1, 3);
-
-			(*this)(2, 0) = other.at(2, 0);
-			(*this)(2, 1) = other.at(2, 1);
-			(*this)(2, 2) = other.at(2, 2);
-			(*this)(2, 3) = other.at(2, 3);
-
-			(*this)(3, 0) = other.at(3, 0);
-			(*this)(3, 1) = other.at(3, 1);
-			(*this)(3, 2) = other.at(3, 2);
-			(*this)(3, 3) = other.at(3, 3);
-
-			return *this;
-		}
+		matrix4& operator = (const matrix4& other) = default;
 
 		/// <summary>
 		/// Performs a matrix multiplication with another Matrix4.
@@ -131,29 +106,25 @@ namespace efiilj
 		/// <returns>The Matrix4 resulting from the operation</returns>
 		matrix4 operator * (const matrix4& other) const
 		{
-			matrix4 mat;
+			const simd::float4 b0 = other.arr_[0].lanes();
+			const simd::float4 b1 = other.arr_[1].lanes();
+			const simd::float4 b2 = other.arr_[2].lanes();
+			const simd::float4 b3 = other.arr_[3].lanes();
 
-			mat(0, 0) = vector4::dot4(row(0), other.col(0));
-			mat(0, 1) = vector4::dot4(row(1), other.col(0));
-			mat(0, 2) = vector4::dot4(row(2), other.col(0));
-			mat(0, 3) = vector4::dot4(row(3), other.col(0));
-
-			mat(1, 0) = vector4::dot4(row(0), other.col(1));
-			mat(1, 1) = vector4::dot4(row(1), other.col(1));
-			mat(1, 2) = vector4::dot4(row(2), other.col(1));
-			mat(1, 3) = vector4::dot4(row(3), other.col(1));
-
-			mat(2, 0) = vector4::dot4(row(0), other.col(2));
-			mat(2, 1) = vector4::dot4(row(1), other.col(2));
-			mat(2, 2) = vector4::dot4(row(2), other.col(2));
-			mat(2, 3) = vector4::dot4(row(3), other.col(2));
+			// Each row of the product is a combination of the rows of the other matrix,
+			// summed in the same order as the dot product of a row and a column
+			const auto product_row = [&](const vector4& row)
+			{
+				const simd::float4 a = row.lanes();
 
-			mat(3, 0) = vector4::dot4(row(0), other.col(3));
-			mat(3, 1) = vector4::dot4(row(1), other.col(3));
-			mat(3, 2) = vector4::dot4(row(2), other.col(3));
-			mat(3, 3) = vector4::dot4(row(3), other.col(3));
+				return vector4(simd::add(simd::add(simd::add(
+					simd::mul(simd::lane_splat<0>(a), b0),
+					simd::mul(simd::lane_splat<1>(a), b1)),
+					simd::mul(simd::lane_splat<2>(a), b2)),
+					simd::mul(simd::lane_splat<3>(a), b3)));
+			};
 
-			return mat;
+			return matrix4(product_row(arr_[0]), product_row(arr_[1]), product_row(arr_[2]), product_row(arr_[3]));
 		}
 
 		/// <summary>
@@ -163,14 +134,7 @@ namespace efiilj
 		/// <returns>The Matrix4 resulting from the operation</returns>
 		matrix4 operator * (const float& other) const
 		{
-			matrix4 mat = *this;
-
-			for (int i = 0; i < 16; i++)
-			{
-				mat(i) *= other;
-			}
-
-			return mat;
+			return matrix4(arr_[0] * other, arr_[1] * other, arr_[2] * other, arr_[3] * other);
 		}
 
 		/// <summary>
@@ -180,12 +144,19 @@ namespace efiilj
 		/// <returns>The Vector4 resulting from the operation</returns>
 		vector4 operator * (const vector4& other) const
 		{
-			vector4 vect;
-			vect.x(other.dot4(row(0)));
-			vect.y(other.dot4(row(1)));
-			vect.z(other.dot4(row(2)));
-			vect.w(other.dot4(row(3)));
-			return vect;
+			simd::float4 c0 = arr_[0].lanes();
+			simd::float4 c1 = arr_[1].lanes();
+			simd::float4 c2 = arr_[2].lanes();
+			simd::float4 c3 = arr_[3].lanes();
+			simd::transpose(c0, c1, c2, c3);
+
+			// Summed in the same order as the dot product of each row with the vector
+			const simd::float4 v = other.lanes();
+			return vector4(simd::add(simd::add(simd::add(
+				simd::mul(c0, simd::lane_splat<0>(v)),
+				simd::mul(c1, simd::lane_splat<1>(v))),
+				simd::mul(c2, simd::lane_splat<2>(v))),
+				simd::mul(c3, simd::lane_splat<3>(v))));
 		}
 
 		/// <summary>
@@ -380,57 +351,69 @@ namespace efiilj
 		/// <returns>Transposed copy of the current matrix</returns>
 		matrix4 transpose() const
 		{
-			matrix4 mat;
-
-			mat(0, 0) = at(0, 0);
-			mat(0, 1) = at(1, 0);
-			mat(0, 2) = at(2, 0);
-			mat(0, 3) = at(3, 0);
-
-			mat(1, 0) = at(0, 1);
-			mat(1, 1) = at(1, 1);
-			mat(1, 2) = at(2, 1);
-			mat(1, 3) = at(3, 1);
+			simd::float4 a = arr_[0].lanes();
+			simd::float4 b = arr_[1].lanes();
+			simd::float4 c = arr_[2].lanes();
+			simd::float4 d = arr_[3].lanes();
+			simd::transpose(a, b, c, d);
 
-			mat(2, 0) = at(0, 2);
-			mat(2, 1) = at(1, 2);
-			mat(2, 2) = at(2, 2);
-			mat(2, 3) = at(3, 2);
-
-			mat(3, 0) = at(0, 3);
-			mat(3, 1) = at(1, 3);
-			mat(3, 2) = at(2, 3);
-			mat(3, 3) = at(3, 3);
-
-			return mat;
+			return matrix4(vector4(a), vector4(b), vector4(c), vector4(d));
 		}
 
 		/// <summary>
 		/// Returns the inverse of the matrix, or an identity if none exists.
+		/// Cofactors are expanded from the twelve 2x2 determinants of the upper and lower two rows, which they share.
 		/// </summary>
 		/// <returns>The inverse of the current matrix</returns>
 		matrix4 inverse() const
 		{
-			matrix4 inv;
-			const float det = determinant();
-
-			if (det == 0)
-				return inv;
-
+			float m[4][4];
 			for (int y = 0; y < 4; y++)
-			{
-				for (int x = 0; x < 4; x++)
-				{
-					inv(x, y) = minor(x, y).determinant();
+				simd::store(m[y], arr_[y].lanes());
 
-					if ((x + (y % 2 == 0)) % 2 == 0)
-						inv(x, y) *= -1;
-				}
-			}
+			// 2x2 determinants of the upper two rows, and of the lower two rows
+			const float s0 = m[0][0] * m[1][1] - m[1][0] * m[0][1];
+			const float s1 = m[0][0] * m[1][2] - m[1][0] * m[0][2];
+			const float s2 = m[0][0] * m[1][3] - m[1][0] * m[0][3];
+			const float s3 = m[0][1] * m[1][2] - m[1][1] * m[0][2];
+			const float s4 = m[0][1] * m[1][3] - m[1][1] * m[0][3];
+			const float s5 = m[0][2] * m[1][3] - m[1][2] * m[0][3];
 
-			inv = inv.transpose();
+			const float c5 = m[2][2] * m[3][3] - m[3][2] * m[2][3];
+			const float c4 = m[2][1] * m[3][3] - m[3][1] * m[2][3];
+			const float c3 = m[2][1] * m[3][2] - m[3][1] * m[2][2];
+			const float c2 = m[2][0] * m[3][3] - m[3][0] * m[2][3];
+			const float c1 = m[2][0] * m[3][2] - m[3][0] * m[2][2];
+			const float c0 = m[2][0] * m[3][1] - m[3][0] * m[2][1];
 
-			return inv / det;
+			const float det = s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+
+			if (det == 0)
+				return matrix4();
+
+			const float inv = 1 / det;
+
+			return matrix4(
+				vector4(
+					(m[1][1] * c5 - m[1][2] * c4 + m[1][3] * c3) * inv,
+					(-m[0][1] * c5 + m[0][2] * c4 - m[0][3] * c3) * inv,
+					(m[3][1] * s5 - m[3][2] * s4 + m[3][3] * s3) * inv,
+					(-m[2][1] * s5 + m[2][2] * s4 - m[2][3] * s3) * inv),
+				vector4(
+					(-m[1][0] * c5 + m[1][2] * c2 - m[1][3] * c1) * inv,
+					(m[0][0] * c5 - m[0][2] * c2 + m[0][3] * c1) * inv,
+					(-m[3][0] * s5 + m[3][2] * s2 - m[3][3] * s1) * inv,
+					(m[2][0] * s5 - m[2][2] * s2 + m[2][3] * s1) * inv),
+				vector4(
+					(m[1][0] * c4 - m[1][1] * c2 + m[1][3] * c0) * inv,
+					(-m[0][0] * c4 + m[0][1] * c2 - m[0][3] * c0) * inv,
+					(m[3][0] * s4 - m[3][1] * s2 + m[3][3] * s0) * inv,
+					(-m[2][0] * s4 + m[2][1] * s2 - m[2][3] * s0) * inv),
+				vector4(
+					(-m[1][0] * c3 + m[1][1] * c1 - m[1][2] * c0) * inv,
+					(m[0][0] * c3 - m[0][1] * c1 + m[0][2] * c0) * inv,
+					(-m[3][0] * s3 + m[3][1] * s1 - m[3][2] * s0) * inv,
+					(m[2][0] * s3 - m[2][1] * s1 + m[2][2] * s0) * inv));
 		}
 
 		/* === FACTORY FUNCTIONS === */
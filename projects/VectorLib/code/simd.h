@@ -0,0 +1,99 @@
+#pragma once
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define VECTORLIB_SSE
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#define VECTORLIB_NEON
+#include <arm_neon.h>
+#endif
+
+namespace efiilj
+{
+	/// <summary>
+	/// Thin wrappers around four-lane float registers (SSE or NEON), with a scalar fallback.
+	/// Each operation is a single lane-wise IEEE operation, so results match the equivalent scalar code exactly.
+	/// Loads and stores do not require alignment, so vectors may be stored anywhere (such as inside a vertex).
+	/// </summary>
+	namespace simd
+	{
+#if defined(VECTORLIB_SSE)
+
+		typedef __m128 float4;
+
+		inline float4 load(const float* src) { return _mm_loadu_ps(src); }
+		inline void store(float* dst, const float4 v) { _mm_storeu_ps(dst, v); }
+		inline float4 splat(const float f) { return _mm_set1_ps(f); }
+
+		inline float4 add(const float4 a, const float4 b) { return _mm_add_ps(a, b); }
+		inline float4 sub(const float4 a, const float4 b) { return _mm_sub_ps(a, b); }
+		inline float4 mul(const float4 a, const float4 b) { return _mm_mul_ps(a, b); }
+
+		/// <summary>
+		/// Broadcasts one lane of a register to all lanes.
+		/// </summary>
+		template <int lane>
+		float4 lane_splat(const float4 v) { return _mm_shuffle_ps(v, v, _MM_SHUFFLE(lane, lane, lane, lane)); }
+
+		/// <summary>
+		/// Transposes four registers holding the rows of a 4x4 matrix, so that they hold its columns.
+		/// </summary>
+		inline void transpose(float4& a, float4& b, float4& c, float4& d) { _MM_TRANSPOSE4_PS(a, b, c, d); }
+
+#elif defined(VECTORLIB_NEON)
+
+		typedef float32x4_t float4;
+
+		inline float4 load(const float* src) { return vld1q_f32(src); }
+		inline void store(float* dst, const float4 v) { vst1q_f32(dst, v); }
+		inline float4 splat(const float f) { return vdupq_n_f32(f); }
+
+		inline float4 add(const float4 a, const float4 b) { return vaddq_f32(a, b); }
+		inline float4 sub(const float4 a, const float4 b) { return vsubq_f32(a, b); }
+		inline float4 mul(const float4 a, const float4 b) { return vmulq_f32(a, b); }
+
+		template <int lane>
+		float4 lane_splat(const float4 v) { return vdupq_n_f32(vgetq_lane_f32(v, lane)); }
+
+		inline void transpose(float4& a, float4& b, float4& c, float4& d)
+		{
+			const float32x4x2_t ab = vtrnq_f32(a, b);
+			const float32x4x2_t cd = vtrnq_f32(c, d);
+
+			a = vcombine_f32(vget_low_f32(ab.val[0]), vget_low_f32(cd.val[0]));
+			b = vcombine_f32(vget_low_f32(ab.val[1]), vget_low_f32(cd.val[1]));
+			c = vcombine_f32(vget_high_f32(ab.val[0]), vget_high_f32(cd.val[0]));
+			d = vcombine_f32(vget_high_f32(ab.val[1]), vget_high_f32(cd.val[1]));
+		}
+
+#else
+
+		struct float4
+		{
+			float lanes[4];
+		};
+
+		inline float4 load(const float* src) { return float4 { { src[0], src[1], src[2], src[3] } }; }
+		inline void store(float* dst, const float4 v) { for (int i = 0; i < 4; i++) dst[i] = v.lanes[i]; }
+		inline float4 splat(const float f) { return float4 { { f, f, f, f } }; }
+
+		inline float4 add(const float4 a, const float4 b) { float4 r; for (int i = 0; i < 4; i++) r.lanes[i] = a.lanes[i] + b.lanes[i]; return r; }
+		inline float4 sub(const float4 a, const float4 b) { float4 r; for (int i = 0; i < 4; i++) r.lanes[i] = a.lanes[i] - b.lanes[i]; return r; }
+		inline float4 mul(const float4 a, const float4 b) { float4 r; for (int i = 0; i < 4; i++) r.lanes[i] = a.lanes[i] * b.lanes[i]; return r; }
+
+		template <int lane>
+		float4 lane_splat(const float4 v) { return splat(v.lanes[lane]); }
+
+		inline void transpose(float4& a, float4& b, float4& c, float4& d)
+		{
+			const float4 rows[4] = { a, b, c, d };
+			float4* cols[4] = { &a, &b, &c, &d };
+
+			for (int i = 0; i < 4; i++)
+				for (int j = 0; j < 4; j++)
+					cols[i]->lanes[j] = rows[j].lanes[i];
+		}
+
+#endif
+	}
+}
@@ -6,6 +6,7 @@
 #include <stdexcept>
 
 #include "vector3.h"
+#include "simd.h"
 
 namespace efiilj
 {
@@ -71,11 +72,19 @@ namespace efiilj
 		/// Constructs a copy of the specified vector.
 		/// </summary>
 		/// <param name="copy">The vector of which to create a copy</param>
-		vector4(const vector4& copy)
+		vector4(const vector4& copy) = default;
+
+		/// <summary>
+		/// Creates a new 4D vector from the four lanes of a SIMD register.
+		/// </summary>
+		/// <param name="lanes">The register holding x, y, z and w, in that order</param>
+		explicit vector4(const simd::float4 lanes)
 		{
-			*this = copy;
+			simd::store(arr_, lanes);
 		}
 
+		vector4& operator = (const vector4& other) = default;
+
 		/* === ACCESSORS === */
 
 		const float& x() const { return this->arr_[0]; }
@@ -90,6 +99,12 @@ namespace efiilj
 		const float& w() const { return arr_[3]; }
 		void w(const float& w) { this->arr_[3] = w; }
 
+		/// <summary>
+		/// Loads the vector into a SIMD register, with x, y, z and w in lanes 0 to 3.
+		/// </summary>
+		/// <returns>A register holding the vector</returns>
+		simd::float4 lanes() const { return simd::load(arr_); }
+
 		/* === OPERATORS === */
 
 		/// <summary>
@@ -99,10 +114,8 @@ namespace efiilj
 		/// <returns>The Vector4 resulting from the operation</returns>
 		vector4 operator + (const vector4& other) const
 		{
-			vector4 vect;
-			vect.x(this->x() + other.x());
-			vect.y(this->y() + other.y());
-			vect.z(this->z() + other.z());
+			vector4 vect(simd::add(lanes(), other.lanes()));
+			vect.w(1);
 			return vect;
 		}
 
@@ -113,10 +126,8 @@ namespace efiilj
 		/// <returns>The Vector4 resulting from the operation</returns>
 		vector4 operator - (const vector4& other) const
 		{
-			vector4 vect;
-			vect.x(this->x() - other.x());
-			vect.y(this->y() - other.y());
-			vect.z(this->z() - other.z());
+			vector4 vect(simd::sub(lanes(), other.lanes()));
+			vect.w(1);
 			return vect;
 		}
 
@@ -127,12 +138,7 @@ namespace efiilj
 		/// <returns>The Vector4 resulting from the operation</returns>
 		vector4 operator * (const vector4& other) const
 		{
-			vector4 vect;
-			vect.x(this->x() * other.x());
-			vect.y(this->y() * other.y());
-			vect.z(this->z() * other.z());
-			vect.w(this->w() * other.w());
-			return vect;
+			return vector4(simd::mul(lanes(), other.lanes()));
 		}
 
 		/// <summary>
@@ -142,12 +148,7 @@ namespace efiilj
 		/// <returns>The Vector4 resulting from the operation</returns>
 		vector4 operator * (const float& other) const
 		{
-			vector4 vect;
-			vect.x(this->x() * other);
-			vect.y(this->y() * other);
-			vect.z(this->z() * other);
-			vect.w(this->w() * other);
-			return vect;
+			return vector4(simd::mul(lanes(), simd::splat(other)));
 		}
 
 		/// <summary>
@@ -417,6 +418,6 @@ namespace efiilj
 			return ss.str();
 		}
 
-		~vector4() { }
+		~vector4() = default;
 	};
 }
\ No newline at end of file